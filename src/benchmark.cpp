@@ -0,0 +1,651 @@
+#include "benchmark.h"
+#include "cube_emit.h"
+#include "fractal.h"
+#include "menger.h"
+#include "occlusion_raster.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const float SPONGE_X = -0.8f;
+    const float SPONGE_Y = -0.8f;
+    const float SPONGE_Z = 0.0f;
+    const float SPONGE_WIDTH = 1.8f;
+
+    // FNV-1a over the raw bytes, used to check that two generators produce identical output
+    unsigned long long hashBytes(const void* data, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // recursive push_back generator vs exact-size iterative generator
+    void benchmarkGenerate(int maxDepth)
+    {
+        std::cout << "generate: push_back menger() vs exact-size mengerExact()" << std::endl;
+        std::cout << std::setw(6) << "depth" << std::setw(12) << "cubes" << std::setw(12) << "MB"
+                  << std::setw(14) << "push_back ms" << std::setw(12) << "exact ms" << std::setw(10) << "speedup"
+                  << std::setw(10) << "equal" << std::endl;
+
+        for (int depth = 1; depth <= maxDepth; depth++)
+        {
+            double megabytes = mengerFloatCount(depth) * sizeof(float) / (1024.0 * 1024.0);
+            std::cout << std::setw(6) << depth << std::setw(12) << mengerCubeCount(depth)
+                      << std::setw(12) << std::fixed << std::setprecision(1) << megabytes;
+
+            try
+            {
+                // only one buffer alive at a time, depth 6 alone needs 3.5 GB
+                VertexData exact;
+                auto start = std::chrono::steady_clock::now();
+                mengerExact(exact, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                double exactMs = elapsedMs(start);
+                unsigned long long exactHash = hashBytes(exact.data, exact.size * sizeof(float));
+                exact.clear();
+
+                std::vector<float> vertices;
+                start = std::chrono::steady_clock::now();
+                menger(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                double pushBackMs = elapsedMs(start);
+                bool equal = hashBytes(vertices.data(), vertices.size() * sizeof(float)) == exactHash;
+
+                std::cout << std::setw(14) << std::setprecision(2) << pushBackMs << std::setw(12) << exactMs
+                          << std::setw(9) << pushBackMs / exactMs << "x" << std::setw(10) << (equal ? "yes" : "NO")
+                          << std::endl;
+            }
+            catch (const std::bad_alloc&)
+            {
+                std::cout << "  out of memory, skipped" << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    // speedup of mengerParallel() per thread count, output checked against the serial generator
+    void benchmarkParallel(int depth)
+    {
+        unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::cout << "parallel: mengerParallel() at depth " << depth << ", " << hardwareThreads
+                  << " hardware threads" << std::endl;
+
+        try
+        {
+            VertexData vertices;
+            auto start = std::chrono::steady_clock::now();
+            mengerExact(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+            double serialMs = elapsedMs(start);
+            unsigned long long serialHash = hashBytes(vertices.data, vertices.size * sizeof(float));
+            vertices.clear();
+            std::cout << "serial " << std::fixed << std::setprecision(2) << serialMs << " ms, hash " << std::hex
+                      << serialHash << std::dec << std::endl;
+
+            std::vector<unsigned int> threadCounts;
+            for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+                threadCounts.push_back(threads);
+            threadCounts.push_back(hardwareThreads);
+
+            std::cout << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "speedup"
+                      << std::setw(12) << "efficiency" << std::setw(12) << "identical" << std::endl;
+            for (unsigned int threads : threadCounts)
+            {
+                start = std::chrono::steady_clock::now();
+                mengerParallel(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth, threads);
+                double ms = elapsedMs(start);
+                bool identical = hashBytes(vertices.data, vertices.size * sizeof(float)) == serialHash;
+                vertices.clear();
+
+                std::cout << std::setw(8) << threads << std::setw(12) << ms << std::setw(9) << serialMs / ms << "x"
+                          << std::setw(11) << 100.0 * serialMs / ms / threads << "%" << std::setw(12)
+                          << (identical ? "yes" : "NO") << std::endl;
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            std::cout << "out of memory, skipped" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    // triangle counts with and without the faces hidden between touching cubes
+    void benchmarkFaces(int maxDepth)
+    {
+        std::cout << "faces: all cube faces vs visible faces only (mengerVisibleFaces())" << std::endl;
+        std::cout << std::setw(6) << "depth" << std::setw(14) << "triangles" << std::setw(14) << "visible"
+                  << std::setw(10) << "removed" << std::setw(12) << "MB" << std::setw(12) << "visible MB"
+                  << std::setw(10) << "ms" << std::setw(10) << "formula" << std::endl;
+
+        for (int depth = 1; depth <= maxDepth; depth++)
+        {
+            size_t triangles = mengerCubeCount(depth) * 12;
+            std::cout << std::setw(6) << depth << std::setw(14) << triangles;
+
+            try
+            {
+                VertexData vertices;
+                auto start = std::chrono::steady_clock::now();
+                mengerVisibleFaces(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth, 0);
+                double ms = elapsedMs(start);
+
+                size_t visible = vertices.vertexCount() / 3;
+                double megabytes = mengerFloatCount(depth) * sizeof(float) / (1024.0 * 1024.0);
+                double visibleMegabytes = vertices.size * sizeof(float) / (1024.0 * 1024.0);
+                bool formula = visible == mengerVisibleFaceCount(depth) * 2;
+
+                std::cout << std::setw(14) << visible << std::setw(9) << std::fixed << std::setprecision(1)
+                          << 100.0 * (triangles - visible) / triangles << "%" << std::setw(12) << megabytes
+                          << std::setw(12) << visibleMegabytes << std::setw(10) << std::setprecision(2) << ms
+                          << std::setw(10) << (formula ? "ok" : "WRONG") << std::endl;
+            }
+            catch (const std::bad_alloc&)
+            {
+                std::cout << "  out of memory, skipped" << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    // vertex count and upload size of visible faces vs greedy merged rectangles
+    void benchmarkGreedy(int maxDepth)
+    {
+        std::cout << "greedy: visible faces vs merged rectangles (mengerGreedy())" << std::endl;
+        std::cout << std::setw(6) << "depth" << std::setw(14) << "vertices" << std::setw(14) << "merged"
+                  << std::setw(12) << "MB" << std::setw(12) << "merged MB" << std::setw(10) << "saved"
+                  << std::setw(10) << "ms" << std::endl;
+
+        for (int depth = 1; depth <= maxDepth; depth++)
+        {
+            try
+            {
+                size_t vertices = mengerVisibleFaceCount(depth) * 6;
+                VertexData merged;
+                auto start = std::chrono::steady_clock::now();
+                mengerGreedy(merged, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth, 0);
+                double ms = elapsedMs(start);
+
+                double megabytes = vertices * MENGER_VERTEX_FLOATS * sizeof(float) / (1024.0 * 1024.0);
+                double mergedMegabytes = merged.size * sizeof(float) / (1024.0 * 1024.0);
+                std::cout << std::setw(6) << depth << std::setw(14) << vertices << std::setw(14)
+                          << merged.vertexCount() << std::setw(12) << std::fixed << std::setprecision(1) << megabytes
+                          << std::setw(12) << mergedMegabytes << std::setw(9)
+                          << 100.0 * (1.0 - mergedMegabytes / megabytes) << "%" << std::setw(10)
+                          << std::setprecision(2) << ms << std::endl;
+            }
+            catch (const std::bad_alloc&)
+            {
+                std::cout << std::setw(6) << depth << "  out of memory, skipped" << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    // 8-float vertices vs lattice-quantized 8-byte vertices of the visible faces; the dequantized positions
+    // are compared with the float ones, which carry the rounding of the double -> float generator
+    void benchmarkCompact(int maxDepth)
+    {
+        std::cout << "compact: float vertices (mengerVisibleFaces()) vs lattice vertices (mengerCompact())" << std::endl;
+        std::cout << std::setw(6) << "depth" << std::setw(14) << "vertices" << std::setw(12) << "float MB"
+                  << std::setw(12) << "compact MB" << std::setw(10) << "ratio" << std::setw(12) << "float ms"
+                  << std::setw(12) << "compact ms" << std::setw(14) << "max error" << std::endl;
+
+        for (int depth = 1; depth <= std::min(maxDepth, MENGER_COMPACT_MAX_DEPTH); depth++)
+        {
+            try
+            {
+                VertexData vertices;
+                auto start = std::chrono::steady_clock::now();
+                mengerVisibleFaces(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth, 0);
+                double floatMs = elapsedMs(start);
+
+                CompactVertexData compact;
+                start = std::chrono::steady_clock::now();
+                mengerCompact(compact, depth, true, 0);
+                double compactMs = elapsedMs(start);
+
+                // the same dequantization as the vertex shader
+                const float origin[3] = {SPONGE_X, SPONGE_Y, SPONGE_Z};
+                const float cellWidth = SPONGE_WIDTH / (float)mengerLatticeSize(depth);
+                double maxError = 0.0;
+                for (size_t v = 0; v < compact.size; v++)
+                {
+                    const CompactVertex& c = compact.data[v];
+                    const unsigned short lattice[3] = {c.x, c.y, c.z};
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        double position = origin[axis] + lattice[axis] * cellWidth;
+                        double error = std::abs(position - vertices.data[v * MENGER_VERTEX_FLOATS + axis]);
+                        maxError = std::max(maxError, error);
+                    }
+                }
+
+                double floatMegabytes = vertices.size * sizeof(float) / (1024.0 * 1024.0);
+                double compactMegabytes = compact.size * sizeof(CompactVertex) / (1024.0 * 1024.0);
+                std::cout << std::setw(6) << depth << std::setw(14) << compact.size << std::setw(12) << std::fixed
+                          << std::setprecision(1) << floatMegabytes << std::setw(12) << compactMegabytes
+                          << std::setw(9) << floatMegabytes / compactMegabytes << "x" << std::setw(12)
+                          << std::setprecision(2) << floatMs << std::setw(12) << compactMs << std::setw(14)
+                          << std::scientific << std::setprecision(1) << maxError << std::endl;
+            }
+            catch (const std::bad_alloc&)
+            {
+                std::cout << std::setw(6) << depth << "  out of memory, skipped" << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    // cells of (x, y, z, width) boxes that touch a face of the sponge's bounding cube turned to the eye: nothing of the
+    // sponge lies between such a face and the eye, so occlusion culling must leave these cells visible
+    std::vector<char> exposedCells(const float* boxes, size_t count, const glm::vec3& eye)
+    {
+        const float low[3] = {SPONGE_X, SPONGE_Y, SPONGE_Z};
+        const float tolerance = SPONGE_WIDTH * 1e-4f;
+        std::vector<char> exposed(count, 0);
+        for (size_t n = 0; n < count; n++)
+        {
+            const float* box = boxes + n * MENGER_INSTANCE_FLOATS;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (eye[axis] < low[axis] && box[axis] - low[axis] < tolerance)
+                    exposed[n] = 1;
+                if (eye[axis] > low[axis] + SPONGE_WIDTH && low[axis] + SPONGE_WIDTH - (box[axis] + box[3]) < tolerance)
+                    exposed[n] = 1;
+            }
+        }
+        return exposed;
+    }
+
+    // software occlusion culling: rasterization of the occluders and tests of the cell boxes, with SSE2 and with the
+    // scalar loops, in the window's default head-on view of the sponge and turned by 30 and 40 degrees; "wrong" counts
+    // the cells on the faces turned to the camera that some of the tests reported hidden, it has to be 0
+    void benchmarkOcclusion(int maxDepth)
+    {
+        const int repeats = 50;
+        const size_t maxOccluders = 16384;
+        std::cout << "occlusion: CPU depth rasterizer, 320 x 320, " << repeats << " runs each" << std::endl;
+        std::cout << std::setw(8) << "view" << std::setw(6) << "depth" << std::setw(10) << "quads" << std::setw(12)
+                  << "raster ms" << std::setw(12) << "scalar ms" << std::setw(12) << "Mtri/s" << std::setw(8) << "cells"
+                  << std::setw(10) << "test ms" << std::setw(12) << "scalar ms" << std::setw(12) << "threads ms"
+                  << std::setw(12) << "Mboxes/s" << std::setw(10) << "hidden" << std::setw(8) << "wrong"
+                  << std::setw(8) << "equal" << std::endl;
+
+        const float views[2][2] = {{0.0f, 0.0f}, {30.0f, 40.0f}};
+        for (const float* angles : views)
+        {
+            glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(angles[0]), glm::vec3(1.0f, 0.0f, 0.0f));
+            model = glm::rotate(model, glm::radians(angles[1]), glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -6.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 matrix = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f) * view * model;
+            const float* m = glm::value_ptr(matrix);
+            const glm::vec3 eye = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+            const std::string viewName = std::to_string(int(angles[0])) + "/" + std::to_string(int(angles[1]));
+
+            for (int depth = 2; depth <= std::min(maxDepth, 5); depth++)
+            {
+                std::vector<float> occluders;
+                mengerOccluders(occluders, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth, maxOccluders, 0);
+                const size_t quads = occluders.size() / 12;
+                const int cellLevels = std::min(depth - 1, 3);
+                VertexData boxes;
+                mengerInstances(boxes, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, cellLevels + 1, 0);
+                const size_t cells = boxes.size / MENGER_INSTANCE_FLOATS;
+                const std::vector<char> exposed = exposedCells(boxes.data, cells, eye);
+
+                OcclusionRaster raster(320, 320);
+                double rasterMs[2], testMs[2];
+                unsigned long long depthHash[2];
+                std::vector<char> visible;
+                size_t wrong = 0;
+                auto countWrong = [&]()
+                {
+                    for (size_t n = 0; n < cells; n++)
+                        wrong += exposed[n] && !visible[n];
+                };
+                for (int simd = 1; simd >= 0; simd--)
+                {
+                    raster.setSimd(simd != 0);
+                    auto start = std::chrono::steady_clock::now();
+                    for (int run = 0; run < repeats; run++)
+                    {
+                        raster.clear();
+                        raster.rasterizeQuads(m, occluders.data(), quads);
+                        raster.finish();
+                    }
+                    rasterMs[simd] = elapsedMs(start) / repeats;
+                    depthHash[simd] = hashBytes(raster.depth().data(), raster.depth().size() * sizeof(float));
+
+                    start = std::chrono::steady_clock::now();
+                    for (int run = 0; run < repeats; run++)
+                    {
+                        visible.assign(cells, 1);
+                        raster.cullBoxes(m, boxes.data, cells, visible, 1);
+                    }
+                    testMs[simd] = elapsedMs(start) / repeats;
+                    countWrong();
+                }
+
+                raster.setSimd(true);
+                auto start = std::chrono::steady_clock::now();
+                for (int run = 0; run < repeats; run++)
+                {
+                    visible.assign(cells, 1);
+                    raster.cullBoxes(m, boxes.data, cells, visible, 0);
+                }
+                double threadsMs = elapsedMs(start) / repeats;
+                size_t hidden = std::count(visible.begin(), visible.end(), 0);
+                countWrong();
+
+                // the SIMD and scalar paths evaluate the same expressions, so the buffers match
+                std::cout << std::setw(8) << viewName << std::setw(6) << depth << std::setw(10) << quads << std::fixed
+                          << std::setprecision(3) << std::setw(12) << rasterMs[1] << std::setw(12) << rasterMs[0]
+                          << std::setw(12) << std::setprecision(1) << raster.rasterizedTriangles() / rasterMs[1] / 1000.0
+                          << std::setw(8) << cells << std::setprecision(3) << std::setw(10) << testMs[1] << std::setw(12)
+                          << testMs[0] << std::setw(12) << threadsMs << std::setw(12) << std::setprecision(1)
+                          << cells / testMs[1] / 1000.0 << std::setw(9) << 100.0 * hidden / cells << "%" << std::setw(8)
+                          << wrong << std::setw(8) << (depthHash[0] == depthHash[1] ? "yes" : "NO") << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    // emission kernels alone, on a buffer that stays in the cache and on one far larger than it, against memset() of
+    // the large buffer as the bandwidth ceiling; then the whole generator with every kernel
+    void benchmarkEmit(int maxDepth)
+    {
+        const size_t cachedCubes = 32;     // 23 KB of vertices
+        const size_t streamedCubes = 1 << 18; // 180 MB
+        std::vector<float> xs(streamedCubes), ys(streamedCubes), zs(streamedCubes), ws(streamedCubes);
+        for (size_t n = 0; n < streamedCubes; n++)
+        {
+            xs[n] = SPONGE_X + (float)(n % 81) * 0.02f;
+            ys[n] = SPONGE_Y + (float)(n / 81 % 81) * 0.02f;
+            zs[n] = SPONGE_Z + (float)(n / 6561) * 0.02f;
+            ws[n] = 0.02f;
+        }
+        const double cubeBytes = MENGER_CUBE_FLOATS * sizeof(float);
+
+        std::cout << "emit: cube emission kernels, " << cachedCubes << " cubes in cache (" << std::fixed
+                  << std::setprecision(0) << cachedCubes * cubeBytes / 1024.0 << " KB) and " << streamedCubes
+                  << " cubes to memory (" << streamedCubes * cubeBytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+        try
+        {
+            VertexData stream;
+            stream.allocate(streamedCubes * MENGER_CUBE_FLOATS);
+            // memset() of the same buffer is the store bandwidth the kernels can reach, touched once before timing
+            std::memset(stream.data, 0, stream.size * sizeof(float));
+            double memsetMs = 1e30;
+            for (int run = 0; run < 3; run++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                std::memset(stream.data, run + 1, stream.size * sizeof(float));
+                memsetMs = std::min(memsetMs, elapsedMs(start));
+            }
+            double memsetGBs = stream.size * sizeof(float) / (memsetMs * 1e6);
+            std::cout << "memset " << std::setprecision(2) << memsetGBs << " GB/s" << std::endl;
+
+            std::cout << std::setw(8) << "kernel" << std::setw(14) << "cache GB/s" << std::setw(14) << "ns/cube"
+                      << std::setw(14) << "memory GB/s" << std::setw(12) << "of memset" << std::setw(10) << "equal"
+                      << std::endl;
+            VertexData cached;
+            cached.allocate(cachedCubes * MENGER_CUBE_FLOATS);
+            unsigned long long scalarHash = 0;
+            for (int kernel = 0; kernel < EMIT_KERNEL_COUNT; kernel++)
+            {
+                if (!emitKernelSupported((EmitKernel)kernel))
+                {
+                    std::cout << std::setw(8) << emitKernelName((EmitKernel)kernel) << "  not supported" << std::endl;
+                    continue;
+                }
+                const int repeats = 20000;
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; r++)
+                    emitCubes(cached.data, &xs[r % 64], &ys[r % 64], &zs[r % 64], &ws[r % 64], cachedCubes,
+                              (EmitKernel)kernel, false);
+                double cachedMs = elapsedMs(start);
+                double cachedGBs = repeats * cachedCubes * cubeBytes / (cachedMs * 1e6);
+
+                double streamMs = 1e30;
+                for (int run = 0; run < 3; run++)
+                {
+                    start = std::chrono::steady_clock::now();
+                    emitCubes(stream.data, xs.data(), ys.data(), zs.data(), ws.data(), streamedCubes,
+                              (EmitKernel)kernel, true);
+                    streamMs = std::min(streamMs, elapsedMs(start));
+                }
+                double streamGBs = stream.size * sizeof(float) / (streamMs * 1e6);
+                unsigned long long hash = hashBytes(stream.data, stream.size * sizeof(float));
+                if (kernel == EMIT_SCALAR)
+                    scalarHash = hash;
+
+                std::cout << std::setw(8) << emitKernelName((EmitKernel)kernel) << std::setw(14) << cachedGBs
+                          << std::setw(14) << cachedMs * 1e6 / (repeats * (double)cachedCubes) << std::setw(14)
+                          << streamGBs << std::setw(11) << std::setprecision(0) << 100.0 * streamGBs / memsetGBs
+                          << "%" << std::setw(10) << (hash == scalarHash ? "yes" : "NO") << std::setprecision(2)
+                          << std::endl;
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            std::cout << "  out of memory, skipped" << std::endl;
+        }
+
+        // a fresh buffer costs a page fault per 4 KB on its first touch, which hides the generator, and is written
+        // through the cache; the second column writes into a buffer touched before, given as the target, and streams
+        int depth = std::min(maxDepth, 5);
+        std::cout << "mengerExact() at depth " << depth << " per kernel, into a new and into a touched buffer" << std::endl;
+        std::cout << std::setw(8) << "kernel" << std::setw(12) << "new ms" << std::setw(12) << "touched ms"
+                  << std::setw(14) << "touched GB/s" << std::setw(10) << "equal" << std::endl;
+        const EmitKernel previous = emitKernel();
+        unsigned long long scalarHash = 0;
+        for (int kernel = 0; kernel < EMIT_KERNEL_COUNT; kernel++)
+        {
+            if (!emitKernelSupported((EmitKernel)kernel))
+                continue;
+            setEmitKernel((EmitKernel)kernel);
+            try
+            {
+                double freshMs = 1e30, touchedMs = 1e30;
+                for (int run = 0; run < 3; run++)
+                {
+                    VertexData vertices;
+                    auto start = std::chrono::steady_clock::now();
+                    mengerExact(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                    freshMs = std::min(freshMs, elapsedMs(start));
+                }
+                VertexData buffer;
+                buffer.allocate(mengerFloatCount(depth));
+                std::memset(buffer.data, 0, buffer.size * sizeof(float));
+                VertexData vertices;
+                for (int run = 0; run < 3; run++)
+                {
+                    vertices.clear();
+                    vertices.target = buffer.data;
+                    vertices.targetBytes = buffer.size * sizeof(float);
+                    auto start = std::chrono::steady_clock::now();
+                    mengerExact(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                    touchedMs = std::min(touchedMs, elapsedMs(start));
+                }
+                unsigned long long hash = hashBytes(vertices.data, vertices.size * sizeof(float));
+                if (kernel == EMIT_SCALAR)
+                    scalarHash = hash;
+                std::cout << std::setw(8) << emitKernelName((EmitKernel)kernel) << std::setw(12) << freshMs
+                          << std::setw(12) << touchedMs << std::setw(14)
+                          << vertices.size * sizeof(float) / (touchedMs * 1e6) << std::setw(10)
+                          << (hash == scalarHash ? "yes" : "NO") << std::endl;
+            }
+            catch (const std::bad_alloc&)
+            {
+                std::cout << "  out of memory, skipped" << std::endl;
+            }
+        }
+        setEmitKernel(previous);
+        std::cout << std::endl;
+    }
+
+    // template generator of the rule tables against the hand-written Menger generators, then the other rules
+    void benchmarkFractals(int maxDepth)
+    {
+        std::cout << "fractals: fractalGenerate() vs mengerExact() and menger(), Menger sponge" << std::endl;
+        std::cout << std::setw(6) << "depth" << std::setw(12) << "cubes" << std::setw(14) << "push_back ms"
+                  << std::setw(12) << "exact ms" << std::setw(12) << "rule ms" << std::setw(10) << "vs exact"
+                  << std::setw(10) << "equal" << std::endl;
+        for (int depth = 1; depth <= std::min(maxDepth, FRACTAL_MAX_DEPTH); depth++)
+        {
+            std::cout << std::setw(6) << depth << std::setw(12) << mengerCubeCount(depth);
+            try
+            {
+                VertexData exact;
+                auto start = std::chrono::steady_clock::now();
+                mengerExact(exact, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                double exactMs = elapsedMs(start);
+                unsigned long long exactHash = hashBytes(exact.data, exact.size * sizeof(float));
+                exact.clear();
+
+                std::vector<float> vertices;
+                start = std::chrono::steady_clock::now();
+                menger(vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                double pushBackMs = elapsedMs(start);
+                std::vector<float>().swap(vertices);
+
+                VertexData rule;
+                start = std::chrono::steady_clock::now();
+                fractalGenerate(rule, FRACTAL_MENGER, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                double ruleMs = elapsedMs(start);
+                bool equal = hashBytes(rule.data, rule.size * sizeof(float)) == exactHash;
+
+                std::cout << std::fixed << std::setprecision(2) << std::setw(14) << pushBackMs << std::setw(12)
+                          << exactMs << std::setw(12) << ruleMs << std::setw(9) << exactMs / ruleMs << "x"
+                          << std::setw(10) << (equal ? "yes" : "NO") << std::endl;
+            }
+            catch (const std::bad_alloc&)
+            {
+                std::cout << "  out of memory, skipped" << std::endl;
+            }
+        }
+        std::cout << std::endl;
+
+        std::cout << std::setw(10) << "rule" << std::setw(6) << "depth" << std::setw(12) << "cubes" << std::setw(12)
+                  << "MB" << std::setw(12) << "ms" << std::setw(14) << "Mcubes/s" << std::endl;
+        for (int type = FRACTAL_CARPET; type < FRACTAL_TYPE_COUNT; type++)
+        {
+            for (int depth = 1; depth <= std::min(maxDepth, FRACTAL_MAX_DEPTH); depth++)
+            {
+                size_t cubes = fractalCubeCount((FractalType)type, depth);
+                std::cout << std::setw(10) << fractalName((FractalType)type) << std::setw(6) << depth << std::setw(12)
+                          << cubes << std::setw(12) << std::setprecision(1)
+                          << cubes * MENGER_CUBE_FLOATS * sizeof(float) / (1024.0 * 1024.0);
+                try
+                {
+                    VertexData vertices;
+                    auto start = std::chrono::steady_clock::now();
+                    fractalGenerate(vertices, (FractalType)type, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, depth);
+                    double ms = elapsedMs(start);
+                    std::cout << std::setw(12) << std::setprecision(2) << ms << std::setw(14)
+                              << cubes / (ms * 1000.0) << std::endl;
+                }
+                catch (const std::bad_alloc&)
+                {
+                    std::cout << "  out of memory, skipped" << std::endl;
+                }
+            }
+        }
+        std::cout << std::endl;
+    }
+}
+
+int runBenchmarks(int argc, char** argv)
+{
+    // OpenGLPAG --benchmark [name] [max depth]
+    std::string name = argc > 2 ? argv[2] : "all";
+    int maxDepth = argc > 3 ? atoi(argv[3]) : 6;
+    if (maxDepth < 1 || maxDepth > MENGER_MAX_DEPTH)
+    {
+        std::cout << "max depth must be between 1 and " << MENGER_MAX_DEPTH << std::endl;
+        return 1;
+    }
+
+    bool all = name == "all";
+    bool found = false;
+
+    if (all || name == "generate")
+    {
+        benchmarkGenerate(maxDepth);
+        found = true;
+    }
+
+    if (all || name == "parallel")
+    {
+        benchmarkParallel(maxDepth);
+        found = true;
+    }
+
+    if (all || name == "faces")
+    {
+        benchmarkFaces(maxDepth);
+        found = true;
+    }
+
+    if (all || name == "greedy")
+    {
+        benchmarkGreedy(maxDepth);
+        found = true;
+    }
+
+    if (all || name == "compact")
+    {
+        benchmarkCompact(maxDepth);
+        found = true;
+    }
+
+    if (all || name == "occlusion")
+    {
+        benchmarkOcclusion(maxDepth);
+        found = true;
+    }
+
+    if (all || name == "emit")
+    {
+        benchmarkEmit(maxDepth);
+        found = true;
+    }
+
+    if (all || name == "fractals")
+    {
+        benchmarkFractals(maxDepth);
+        found = true;
+    }
+
+    if (!found)
+    {
+        std::cout << "unknown benchmark: " << name << std::endl;
+        std::cout << "available: all, generate, parallel, faces, greedy, compact, occlusion, emit, fractals" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,6 @@
+// CPU benchmarks of the sponge generators, run with: OpenGLPAG --benchmark [name] [max depth]
+// They do not need a window nor an OpenGL context.
+
+#pragma once
+
+int runBenchmarks(int argc, char** argv);
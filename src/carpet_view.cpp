@@ -0,0 +1,121 @@
+#include "carpet_view.h"
+#include "menger.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // rounding towards minus infinity, for the cells left of and below the carpet
+    long long floorDiv3(long long value)
+    {
+        return value >= 0 ? value / 3 : -((-value + 2) / 3);
+    }
+}
+
+CarpetView::CarpetView()
+{
+    reset();
+}
+
+void CarpetView::reset()
+{
+    level = 0;
+    cellX = cellY = 0;
+    x = y = 0.5;
+    height = 1.2;
+}
+
+void CarpetView::pan(double dx, double dy)
+{
+    x += dx * height;
+    y += dy * height;
+    normalize();
+}
+
+void CarpetView::zoom(double factor, double px, double py)
+{
+    x += px * height * (1.0 - 1.0 / factor);
+    y += py * height * (1.0 - 1.0 / factor);
+    height /= factor;
+    normalize();
+}
+
+void CarpetView::normalize()
+{
+    double whole = std::floor(x);
+    cellX += (long long)whole;
+    x -= whole;
+    whole = std::floor(y);
+    cellY += (long long)whole;
+    y -= whole;
+
+    const double finest = std::pow(3.0, -ROOT_LEVELS);
+    // down while the view is more than ROOT_LEVELS levels below the root, up while it is less than ROOT_LEVELS - 1
+    while (height < finest && level < MAX_ROOT_LEVEL)
+    {
+        double digitX = std::floor(x * 3.0), digitY = std::floor(y * 3.0);
+        x = x * 3.0 - digitX;
+        y = y * 3.0 - digitY;
+        cellX = cellX * 3 + (long long)digitX;
+        cellY = cellY * 3 + (long long)digitY;
+        height *= 3.0;
+        level++;
+    }
+    while (height > finest * 3.0 && level > 0)
+    {
+        long long parentX = floorDiv3(cellX), parentY = floorDiv3(cellY);
+        x = (x + (double)(cellX - parentX * 3)) / 3.0;
+        y = (y + (double)(cellY - parentY * 3)) / 3.0;
+        cellX = parentX;
+        cellY = parentY;
+        height /= 3.0;
+        level--;
+    }
+    if (level == MAX_ROOT_LEVEL)
+        height = std::max(height, finest);
+    if (level == 0)
+        height = std::min(height, 4.0);
+
+    // the centre stays within a carpet width of it, which keeps the indices of the deepest root in range
+    const long long size = mengerPower3(level);
+    if (cellX < -size || cellX >= 2 * size)
+    {
+        cellX = std::min(std::max(cellX, -size), 2 * size - 1);
+        x = 0.5;
+    }
+    if (cellY < -size || cellY >= 2 * size)
+    {
+        cellY = std::min(std::max(cellY, -size), 2 * size - 1);
+        y = 0.5;
+    }
+}
+
+int CarpetView::rootMask() const
+{
+    int mask = 0;
+    for (int j = -1; j <= 1; j++)
+    {
+        for (int i = -1; i <= 1; i++)
+        {
+            if (mengerSolidCell(cellX + i, cellY + j, 0, level))
+                mask |= 1 << ((i + 1) + 3 * (j + 1));
+        }
+    }
+    return mask;
+}
+
+double CarpetView::magnification() const
+{
+    return std::pow(3.0, level) / height;
+}
+
+double CarpetView::carpetX() const
+{
+    return ((double)cellX + x) / std::pow(3.0, level);
+}
+
+double CarpetView::carpetY() const
+{
+    return ((double)cellY + y) / std::pow(3.0, level);
+}
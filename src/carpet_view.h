@@ -0,0 +1,49 @@
+// Pan and zoom of the 2D Sierpinski carpet drawn by the fragment shader
+// The carpet is [0, 1]^2. The view centre is kept as a cell of some root level, with exact integer indices, and a
+// position inside that cell in double; the fragment shader gets the position as a double-float and evaluates the
+// levels below the root for every pixel. The root follows the zoom, ROOT_LEVELS levels above the view, so the
+// shader's coordinates stay of the same magnitude at any depth; which of the root cell and its 8 neighbours lie in a
+// hole of the levels above is decided here, on the integers.
+
+#pragma once
+
+class CarpetView
+{
+public:
+    // levels between the root cell and the view height; within them a pixel is down to 3^-ROOT_LEVELS / 2000 of the
+    // coordinates, beyond float precision, within the 48 bits of a double-float
+    static const int ROOT_LEVELS = 12;
+    // deepest root: cell indices below 3^38 fit in 63 bits
+    static const int MAX_ROOT_LEVEL = 38;
+
+    CarpetView();
+
+    // whole carpet in the view
+    void reset();
+    // moves the view by (dx, dy) view heights, y up
+    void pan(double dx, double dy);
+    // scales the view height by 1 / factor keeping the point (x, y) view heights from the centre in place
+    void zoom(double factor, double x, double y);
+
+    int rootLevel() const { return level; }
+    // centre in units of the root cell, from its lower left corner, in [0, 1)
+    double centerX() const { return x; }
+    double centerY() const { return y; }
+    // view height in units of the root cell
+    double viewHeight() const { return height; }
+    // bit (i + 1) + 3 (j + 1) set when the root cell moved by (i, j) lies in the carpet at the root level
+    int rootMask() const;
+    // magnification against the whole carpet filling the view height
+    double magnification() const;
+    // centre in carpet coordinates, as far as a double resolves it
+    double carpetX() const;
+    double carpetY() const;
+
+private:
+    void normalize();
+
+    int level;
+    long long cellX, cellY; // root cell, 0 - 3^level - 1 on the carpet, outside it when panned away
+    double x, y;
+    double height;
+};
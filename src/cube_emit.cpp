@@ -0,0 +1,278 @@
+#include "cube_emit.h"
+#include "fractal.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CUBE_EMIT_SSE2 1
+#include <emmintrin.h>
+#else
+#define CUBE_EMIT_SSE2 0
+#endif
+
+// the AVX2 kernel is compiled for its own target and only called after the CPU reports AVX2
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) || defined(_M_X64)
+#define CUBE_EMIT_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CUBE_EMIT_AVX2_TARGET
+#else
+#define CUBE_EMIT_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#else
+#define CUBE_EMIT_AVX2 0
+#endif
+
+namespace
+{
+    const int CUBE_FLOATS = MENGER_CUBE_FLOATS;
+    // 180 floats of a cube: 22 full vectors of 8 and a last half
+    const int AVX_CHUNKS = (CUBE_FLOATS + 7) / 8;
+
+    float* emitScalar(float* cursor, const float* x, const float* y, const float* z, const float* width, size_t count)
+    {
+        for (size_t n = 0; n < count; n++)
+            cursor = FractalBox::write(cursor, x[n], y[n], z[n], width[n]);
+        return cursor;
+    }
+
+    bool cpuHasAvx2()
+    {
+#if CUBE_EMIT_AVX2 && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        // AVX and OSXSAVE, and the OS saving the YMM registers
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#elif CUBE_EMIT_AVX2
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#else
+        return false;
+#endif
+    }
+
+#if CUBE_EMIT_SSE2
+    // per vertex: the corner (bits x, y, z) and u in the fourth lane; v is stored on its own
+    struct Sse2Tables
+    {
+        Sse2Tables()
+        {
+            for (int corner = 0; corner < 8; corner++)
+            {
+                unsigned int bits[4] = {corner & 1 ? ~0u : 0u, corner & 2 ? ~0u : 0u, corner & 4 ? ~0u : 0u, 0u};
+                cornerMasks[corner] = _mm_castsi128_ps(_mm_setr_epi32((int)bits[0], (int)bits[1], (int)bits[2],
+                                                                      (int)bits[3]));
+            }
+            for (int i = 0; i < MENGER_CUBE_VERTICES; i++)
+            {
+                const FractalBoxVertex& v = FractalBox::VERTICES[i];
+                corners[i] = v.x | (v.y << 1) | (v.z << 2);
+                us[i] = _mm_setr_ps(0.0f, 0.0f, 0.0f, v.u);
+            }
+        }
+
+        __m128 cornerMasks[8];
+        __m128 us[MENGER_CUBE_VERTICES];
+        int corners[MENGER_CUBE_VERTICES];
+    };
+
+    float* emitSse2(float* cursor, const float* x, const float* y, const float* z, const float* width, size_t count)
+    {
+        static const Sse2Tables tables;
+        for (size_t n = 0; n < count; n++)
+        {
+            // lane 3 stays +0, so or-ing u in leaves it exact
+            __m128 low = _mm_setr_ps(x[n], y[n], z[n], 0.0f);
+            __m128 high = _mm_add_ps(low, _mm_setr_ps(width[n], width[n], width[n], 0.0f));
+            __m128 corners[8];
+            for (int corner = 0; corner < 8; corner++)
+                corners[corner] = _mm_or_ps(_mm_andnot_ps(tables.cornerMasks[corner], low),
+                                            _mm_and_ps(tables.cornerMasks[corner], high));
+            // every store covers x, y, z and u of a vertex, v goes between it and the next one
+            for (int i = 0; i < MENGER_CUBE_VERTICES; i++)
+            {
+                _mm_storeu_ps(cursor, _mm_or_ps(corners[tables.corners[i]], tables.us[i]));
+                cursor[4] = FractalBox::VERTICES[i].v;
+                cursor += MENGER_VERTEX_FLOATS;
+            }
+        }
+        return cursor;
+    }
+#endif
+
+#if CUBE_EMIT_AVX2
+    // a cube in one register: x, x + width, y, y + width, z, z + width, 0.5, 1; every 8 output floats are a permute
+    // of it, with the lanes holding 0 masked out
+    struct Avx2Tables
+    {
+        Avx2Tables()
+        {
+            for (int f = 0; f < AVX_CHUNKS * 8; f++)
+            {
+                int index = 0;
+                bool zero = false;
+                if (f < CUBE_FLOATS)
+                {
+                    const FractalBoxVertex& v = FractalBox::VERTICES[f / MENGER_VERTEX_FLOATS];
+                    int component = f % MENGER_VERTEX_FLOATS;
+                    float texture = component == 3 ? v.u : v.v;
+                    if (component < 3)
+                        index = component * 2 + (component == 0 ? v.x : component == 1 ? v.y : v.z);
+                    else if (texture == 0.5f)
+                        index = 6;
+                    else if (texture == 1.0f)
+                        index = 7;
+                    else
+                        zero = true;
+                }
+                indices[f / 8][f % 8] = index;
+                masks[f / 8][f % 8] = zero ? 0 : -1;
+            }
+        }
+
+        alignas(32) int indices[AVX_CHUNKS][8];
+        alignas(32) int masks[AVX_CHUNKS][8];
+    };
+
+    CUBE_EMIT_AVX2_TARGET void transpose8(__m256* rows)
+    {
+        __m256 t[8], u[8];
+        for (int i = 0; i < 8; i += 2)
+        {
+            t[i] = _mm256_unpacklo_ps(rows[i], rows[i + 1]);
+            t[i + 1] = _mm256_unpackhi_ps(rows[i], rows[i + 1]);
+        }
+        for (int i = 0; i < 8; i += 4)
+        {
+            u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+            u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+            u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+            u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            rows[i] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x20);
+            rows[i + 4] = _mm256_permute2f128_ps(u[i], u[i + 4], 0x31);
+        }
+    }
+
+    // 8 floats at cursor; streamed past the cache in two aligned halves, as a cube is only 16-byte aligned
+    template <bool Stream>
+    CUBE_EMIT_AVX2_TARGET void storeAvx2(float* cursor, __m256 value)
+    {
+        if (Stream)
+        {
+            _mm_stream_ps(cursor, _mm256_castps256_ps128(value));
+            _mm_stream_ps(cursor + 4, _mm256_extractf128_ps(value, 1));
+        }
+        else
+        {
+            _mm256_storeu_ps(cursor, value);
+        }
+    }
+
+    template <bool Stream>
+    CUBE_EMIT_AVX2_TARGET float* emitAvx2(float* cursor, const float* x, const float* y, const float* z,
+                                          const float* width, size_t count)
+    {
+        static const Avx2Tables tables;
+        size_t n = 0;
+        for (; n + EMIT_BATCH <= count; n += EMIT_BATCH)
+        {
+            __m256 xs = _mm256_loadu_ps(x + n), ys = _mm256_loadu_ps(y + n), zs = _mm256_loadu_ps(z + n);
+            __m256 ws = _mm256_loadu_ps(width + n);
+            __m256 cubes[8] = {xs, _mm256_add_ps(xs, ws), ys, _mm256_add_ps(ys, ws), zs, _mm256_add_ps(zs, ws),
+                               _mm256_set1_ps(0.5f), _mm256_set1_ps(1.0f)};
+            transpose8(cubes);
+            for (int c = 0; c < EMIT_BATCH; c++)
+            {
+                for (int chunk = 0; chunk < AVX_CHUNKS - 1; chunk++)
+                {
+                    __m256i index = _mm256_load_si256((const __m256i*)tables.indices[chunk]);
+                    __m256 mask = _mm256_load_ps((const float*)tables.masks[chunk]);
+                    storeAvx2<Stream>(cursor + chunk * 8, _mm256_and_ps(_mm256_permutevar8x32_ps(cubes[c], index), mask));
+                }
+                const int last = AVX_CHUNKS - 1;
+                __m256i index = _mm256_load_si256((const __m256i*)tables.indices[last]);
+                __m256 mask = _mm256_load_ps((const float*)tables.masks[last]);
+                __m128 half = _mm256_castps256_ps128(_mm256_and_ps(_mm256_permutevar8x32_ps(cubes[c], index), mask));
+                if (Stream)
+                    _mm_stream_ps(cursor + last * 8, half);
+                else
+                    _mm_storeu_ps(cursor + last * 8, half);
+                cursor += CUBE_FLOATS;
+            }
+        }
+        // streamed stores are weakly ordered, they have to be done before the buffer is handed to another thread
+        if (Stream)
+            _mm_sfence();
+        return emitScalar(cursor, x + n, y + n, z + n, width + n, count - n);
+    }
+#endif
+
+    EmitKernel bestKernel()
+    {
+        if (CUBE_EMIT_AVX2 && cpuHasAvx2())
+            return EMIT_AVX2;
+        if (CUBE_EMIT_SSE2)
+            return EMIT_SSE2;
+        return EMIT_SCALAR;
+    }
+
+    EmitKernel activeKernel = bestKernel();
+}
+
+const char* emitKernelName(EmitKernel kernel)
+{
+    const char* names[EMIT_KERNEL_COUNT] = {"scalar", "SSE2", "AVX2"};
+    return kernel >= 0 && kernel < EMIT_KERNEL_COUNT ? names[kernel] : "";
+}
+
+bool emitKernelSupported(EmitKernel kernel)
+{
+    if (kernel == EMIT_AVX2)
+        return CUBE_EMIT_AVX2 && cpuHasAvx2();
+    if (kernel == EMIT_SSE2)
+        return CUBE_EMIT_SSE2 != 0;
+    return kernel == EMIT_SCALAR;
+}
+
+EmitKernel emitKernel()
+{
+    return activeKernel;
+}
+
+void setEmitKernel(EmitKernel kernel)
+{
+    activeKernel = emitKernelSupported(kernel) ? kernel : bestKernel();
+}
+
+float* emitCubes(float* cursor, const float* x, const float* y, const float* z, const float* width, size_t count,
+                 bool stream)
+{
+    return emitCubes(cursor, x, y, z, width, count, activeKernel, stream);
+}
+
+float* emitCubes(float* cursor, const float* x, const float* y, const float* z, const float* width, size_t count,
+                 EmitKernel kernel, bool stream)
+{
+#if CUBE_EMIT_AVX2
+    if (kernel == EMIT_AVX2)
+    {
+        // the halves of every 8 floats are 16-byte aligned when the cursor is
+        if (stream && ((size_t)cursor & 15) == 0)
+            return emitAvx2<true>(cursor, x, y, z, width, count);
+        return emitAvx2<false>(cursor, x, y, z, width, count);
+    }
+#endif
+#if CUBE_EMIT_SSE2
+    if (kernel == EMIT_SSE2)
+        return emitSse2(cursor, x, y, z, width, count);
+#endif
+    return emitScalar(cursor, x, y, z, width, count);
+}
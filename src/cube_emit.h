@@ -0,0 +1,38 @@
+// Cube emission kernels
+// Write the 36 vertices of writeBox() for a batch of cubes given as structure of arrays (origins and widths). The
+// AVX2 kernel transposes 8 cubes into one register each and builds every 8 output floats with a single permute; the
+// SSE2 kernel builds the 8 corners of a cube and stores a whole vertex at a time; the scalar one copies from the
+// vertex table. All three write the same bytes; the fastest one the CPU runs is picked at run time.
+
+#pragma once
+
+#include <cstddef>
+
+const int EMIT_BATCH = 8;
+
+enum EmitKernel
+{
+    EMIT_SCALAR,
+    EMIT_SSE2,
+    EMIT_AVX2,
+    EMIT_KERNEL_COUNT
+};
+
+const char* emitKernelName(EmitKernel kernel);
+// compiled in and supported by the CPU
+bool emitKernelSupported(EmitKernel kernel);
+// the kernel used by emitCubes() without one given: the best supported one unless set otherwise
+EmitKernel emitKernel();
+// falls back to the best supported kernel when the given one is not
+void setEmitKernel(EmitKernel kernel);
+
+// writes count cubes (x[n], y[n], z[n], width[n]) at cursor, 36 interleaved vertices each, and returns the advanced
+// cursor; full batches of EMIT_BATCH cubes go through the vector kernels, the rest is written by the scalar one;
+// stream: a buffer larger than the cache whose pages are already backed (a mapped GPU buffer, memory written before),
+// the AVX2 kernel skips the cache with non-temporal stores, which do not read the lines they overwrite; freshly
+// allocated pages are better written through the cache the page faults have just zeroed them into. Streamed calls end
+// with a fence, they should pass hundreds of cubes at a time
+float* emitCubes(float* cursor, const float* x, const float* y, const float* z, const float* width, size_t count,
+                 bool stream = false);
+float* emitCubes(float* cursor, const float* x, const float* y, const float* z, const float* width, size_t count,
+                 EmitKernel kernel, bool stream);
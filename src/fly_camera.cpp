@@ -0,0 +1,178 @@
+#include "fly_camera.h"
+#include "menger.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // signed distance of a sponge in [-1, 1]^3 with MAX_CELL_LEVELS levels of holes, the one of the ray marching
+    // shader
+    double cubeDistance(const double* p)
+    {
+        double outside[3], d = -1e30, length = 0.0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            outside[axis] = std::fabs(p[axis]) - 1.0;
+            d = std::max(d, outside[axis]);
+            length += std::max(outside[axis], 0.0) * std::max(outside[axis], 0.0);
+        }
+        d = std::min(d, 0.0) + std::sqrt(length);
+        double scale = 1.0;
+        for (int level = 1; level < FlyCamera::MAX_CELL_LEVELS; level++)
+        {
+            double r[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                double a = p[axis] * scale - 2.0 * std::floor(p[axis] * scale / 2.0) - 1.0;
+                r[axis] = std::fabs(1.0 - 3.0 * std::fabs(a));
+            }
+            scale *= 3.0;
+            double hole = std::min(std::max(r[0], r[1]), std::min(std::max(r[1], r[2]), std::max(r[2], r[0]))) - 1.0;
+            d = std::max(d, hole / scale);
+        }
+        return d;
+    }
+}
+
+FlyCamera::FlyCamera()
+{
+    reset();
+}
+
+void FlyCamera::reset()
+{
+    // 6 in front of the 1.8 wide sponge at (-0.8, -0.8, 0), on the axis of the view
+    level = 0;
+    cell[0] = cell[1] = cell[2] = 0;
+    position[0] = position[1] = 0.8 / 1.8;
+    position[2] = -6.0 / 1.8;
+    yawAngle = pitchAngle = 0.0;
+    normalize();
+}
+
+void FlyCamera::turn(double yaw, double pitch)
+{
+    yawAngle += yaw;
+    pitchAngle = std::min(std::max(pitchAngle + pitch, -1.55), 1.55);
+}
+
+void FlyCamera::basis(double forward[3], double right[3], double up[3]) const
+{
+    forward[0] = std::cos(pitchAngle) * std::sin(yawAngle);
+    forward[1] = std::sin(pitchAngle);
+    forward[2] = std::cos(pitchAngle) * std::cos(yawAngle);
+    // forward x (0, 1, 0), as glm::lookAt() takes it
+    double length = std::sqrt(forward[0] * forward[0] + forward[2] * forward[2]);
+    right[0] = -forward[2] / length;
+    right[1] = 0.0;
+    right[2] = forward[0] / length;
+    up[0] = right[1] * forward[2] - right[2] * forward[1];
+    up[1] = right[2] * forward[0] - right[0] * forward[2];
+    up[2] = right[0] * forward[1] - right[1] * forward[0];
+}
+
+void FlyCamera::move(double forward, double right, double up)
+{
+    double axes[3][3];
+    basis(axes[0], axes[1], axes[2]);
+    double step[3], length = 0.0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        step[axis] = (forward * axes[0][axis] + right * axes[1][axis] + up * axes[2][axis]) * nearest;
+        length += step[axis] * step[axis];
+    }
+    length = std::sqrt(length);
+    double shorten = length > 0.5 * nearest ? 0.5 * nearest / length : 1.0;
+    const double previous[3] = {position[0], position[1], position[2]};
+    for (int axis = 0; axis < 3; axis++)
+        position[axis] += step[axis] * shorten;
+    normalize();
+    // below the deepest root the walls would come closer than the shader resolves
+    if (level == MAX_ROOT_LEVEL && nearest < std::pow(3.0, -ROOT_LEVELS - 1))
+    {
+        for (int axis = 0; axis < 3; axis++)
+            position[axis] = previous[axis];
+        normalize();
+    }
+}
+
+double FlyCamera::scaleLevel() const
+{
+    return level + std::log(1.0 / nearest) / std::log(3.0);
+}
+
+void FlyCamera::normalize()
+{
+    // the root is the cell of the camera, or the nearest one of the sponge when the camera is out of it
+    const long long size = mengerPower3(level);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double whole = std::floor(position[axis]);
+        long long target = std::min(std::max(cell[axis] + (long long)std::max(std::min(whole, 1e15), -1e15), 0LL),
+                                    size - 1);
+        position[axis] -= (double)(target - cell[axis]);
+        cell[axis] = target;
+    }
+    update();
+
+    const double finest = std::pow(3.0, -ROOT_LEVELS);
+    // into the sub-cell of the camera while the walls are nearer than ROOT_LEVELS levels below the root, out while
+    // they are further than ROOT_LEVELS - 1; the same walls are 3 times nearer or further in the units of the new root
+    while (nearest < finest && level < MAX_ROOT_LEVEL)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double digit = std::min(std::max(std::floor(position[axis] * 3.0), 0.0), 2.0);
+            position[axis] = position[axis] * 3.0 - digit;
+            cell[axis] = cell[axis] * 3 + (long long)digit;
+        }
+        level++;
+        update();
+    }
+    while (nearest > finest * 3.0 && level > 0)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            long long parent = cell[axis] / 3;
+            position[axis] = (position[axis] + (double)(cell[axis] - parent * 3)) / 3.0;
+            cell[axis] = parent;
+        }
+        level--;
+        update();
+    }
+}
+
+void FlyCamera::update()
+{
+    mask = 0;
+    for (int n = 0; n < 27; n++)
+    {
+        if (mengerSolidCell(cell[0] + n % 3 - 1, cell[1] + n / 3 % 3 - 1, cell[2] + n / 9 - 1, level))
+            mask |= 1 << n;
+    }
+    nearest = spongeDistance(position);
+}
+
+// nearest of the sponges of the cells in the mask; a cell is only evaluated when its box is nearer than the
+// nearest wall found so far
+double FlyCamera::spongeDistance(const double* point) const
+{
+    double d = 1e30;
+    for (int n = 0; n < 27; n++)
+    {
+        if ((mask & (1 << n)) == 0)
+            continue;
+        const double low[3] = {(double)(n % 3 - 1), (double)(n / 3 % 3 - 1), (double)(n / 9 - 1)};
+        double box = 0.0, local[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double outside = std::max(std::max(low[axis] - point[axis], point[axis] - low[axis] - 1.0), 0.0);
+            box += outside * outside;
+            local[axis] = (point[axis] - low[axis]) * 2.0 - 1.0;
+        }
+        if (std::sqrt(box) < d)
+            d = std::min(d, cubeDistance(local) * 0.5);
+    }
+    return d;
+}
@@ -0,0 +1,55 @@
+// Free-flying camera that dives into the sponge without a depth limit
+// The sponge is [0, 1]^3. As in CarpetView, the camera is kept relative to a root cell with exact integer indices at
+// some level of the hierarchy, ROOT_LEVELS levels above the scale of the camera, which is its distance to the
+// nearest wall; the root and its 26 neighbours are the only part of the sponge drawn, each of them a sponge of its
+// own or empty. The camera moves by fractions of its distance to the sponge, so flying at a wall slows down as the
+// wall nears and the root descends into the cell the camera enters, level after level; the coordinates handed to
+// the shader stay of the same magnitude at any depth.
+
+#pragma once
+
+class FlyCamera
+{
+public:
+    // levels between the root cell and the scale of the camera: the nearest walls are 3^-ROOT_LEVELS to
+    // 3^-(ROOT_LEVELS-1) root cells away, the neighbourhood drawn reaches 3^(ROOT_LEVELS-1) times further
+    static const int ROOT_LEVELS = 4;
+    // deepest root: cell indices below 3^38 fit in 63 bits
+    static const int MAX_ROOT_LEVEL = 38;
+    // levels of holes the sponge of a root cell has at most, on the CPU and in the shader
+    static const int MAX_CELL_LEVELS = 20;
+
+    FlyCamera();
+
+    // in front of the whole sponge, looking at it as the fixed camera of the other modes
+    void reset();
+    // yaw about the vertical axis, pitch up; in radians
+    void turn(double yaw, double pitch);
+    // moves by forward, right and up distances to the sponge, together at most half of it, so the camera never
+    // reaches a wall
+    void move(double forward, double right, double up);
+
+    int rootLevel() const { return level; }
+    // camera in units of the root cell, from its lower corner; outside [0, 1) when the camera is out of the sponge
+    const double* eye() const { return position; }
+    // distance to the nearest wall of the neighbourhood, in units of the root cell
+    double distance() const { return nearest; }
+    // bit (i + 1) + 3 (j + 1) + 9 (k + 1) set when the root cell moved by (i, j, k) lies in the sponge
+    int rootMask() const { return mask; }
+    // unit vectors of the view, in the axes of the sponge
+    void basis(double forward[3], double right[3], double up[3]) const;
+    // level of the hierarchy whose cubes are as large as the distance to the wall, from the whole sponge at 0
+    double scaleLevel() const;
+
+private:
+    void normalize();
+    void update();
+    double spongeDistance(const double* point) const;
+
+    int level;
+    long long cell[3]; // root cell, clamped to the sponge at its level
+    double position[3];
+    double yawAngle, pitchAngle;
+    int mask;
+    double nearest;
+};
@@ -0,0 +1,66 @@
+#include "fractal.h"
+
+// storage of the tables, which the loops take by reference
+constexpr FractalCell MengerRule::CELLS[];
+constexpr FractalCell CarpetRule::CELLS[];
+constexpr FractalCell JerusalemRule::CELLS[];
+constexpr FractalCell MoselyRule::CELLS[];
+constexpr FractalBoxVertex FractalBox::VERTICES[];
+
+namespace
+{
+    template <typename Rule>
+    size_t cubeCount(int depth)
+    {
+        size_t count = 1;
+        for (int level = 1; level < depth; level++)
+            count *= Rule::COUNT;
+        return count;
+    }
+
+    template <typename Rule>
+    void generate(VertexData& out, float xpos, float ypos, float zpos, float width, int depth)
+    {
+        // no instantiation writes other depths, the buffer would be left uninitialized
+        if (depth < 1 || depth > FRACTAL_MAX_DEPTH)
+        {
+            out.clear();
+            return;
+        }
+        out.allocate(cubeCount<Rule>(depth) * MENGER_CUBE_FLOATS);
+        FractalDispatch<Rule>::write(out.data, xpos, ypos, zpos, width, depth);
+    }
+}
+
+const char* fractalName(FractalType type)
+{
+    const char* names[FRACTAL_TYPE_COUNT] = {"menger", "carpet", "jerusalem", "mosely"};
+    return type >= 0 && type < FRACTAL_TYPE_COUNT ? names[type] : "";
+}
+
+size_t fractalCubeCount(FractalType type, int depth)
+{
+    if (type == FRACTAL_MENGER)
+        return cubeCount<MengerRule>(depth);
+    if (type == FRACTAL_CARPET)
+        return cubeCount<CarpetRule>(depth);
+    if (type == FRACTAL_JERUSALEM)
+        return cubeCount<JerusalemRule>(depth);
+    if (type == FRACTAL_MOSELY)
+        return cubeCount<MoselyRule>(depth);
+    return 0;
+}
+
+void fractalGenerate(VertexData& out, FractalType type, float xpos, float ypos, float zpos, float width, int depth)
+{
+    if (type == FRACTAL_MENGER)
+        generate<MengerRule>(out, xpos, ypos, zpos, width, depth);
+    else if (type == FRACTAL_CARPET)
+        generate<CarpetRule>(out, xpos, ypos, zpos, width, depth);
+    else if (type == FRACTAL_JERUSALEM)
+        generate<JerusalemRule>(out, xpos, ypos, zpos, width, depth);
+    else if (type == FRACTAL_MOSELY)
+        generate<MoselyRule>(out, xpos, ypos, zpos, width, depth);
+    else
+        out.clear();
+}
@@ -0,0 +1,183 @@
+// Cube fractals generated from compile-time rule tables
+// A rule is a constexpr table of the sub-cells a cube keeps, in units of 1 / DIVISIONS of its width. The recursion is
+// a template over the rule and the remaining depth, so every level is its own function with the table and the loop
+// bounds known to the compiler: no conditions on the cell indices as in menger(), and the children of a level are
+// computed once, in one pass over the table. The output is the same interleaved vertex data as mengerExact(), 36 vertices per cube.
+
+#pragma once
+
+#include "menger.h"
+
+#include <cstddef>
+
+// origin and edge of a kept sub-cell, in units of the parent width / DIVISIONS
+struct FractalCell
+{
+    double x, y, z, size;
+};
+
+// the Menger sponge: 20 of the 3 x 3 x 3 sub-cubes, without the centre and the centres of the faces; in the order
+// of menger(), so the output matches mengerExact() byte for byte
+struct MengerRule
+{
+    static constexpr int DIVISIONS = 3;
+    static constexpr int COUNT = 20;
+    static constexpr FractalCell CELLS[COUNT] = {
+        {0, 0, 0, 1}, {0, 0, 1, 1}, {0, 0, 2, 1}, {0, 1, 0, 1}, {0, 1, 2, 1}, {0, 2, 0, 1}, {0, 2, 1, 1}, {0, 2, 2, 1},
+        {1, 0, 0, 1}, {1, 0, 2, 1}, {1, 2, 0, 1}, {1, 2, 2, 1},
+        {2, 0, 0, 1}, {2, 0, 1, 1}, {2, 0, 2, 1}, {2, 1, 0, 1}, {2, 1, 2, 1}, {2, 2, 0, 1}, {2, 2, 1, 1}, {2, 2, 2, 1},
+    };
+};
+
+// the Sierpinski carpet as a layer of cubes: 8 of the 3 x 3 sub-cubes of the front slab, without the centre
+struct CarpetRule
+{
+    static constexpr int DIVISIONS = 3;
+    static constexpr int COUNT = 8;
+    static constexpr FractalCell CELLS[COUNT] = {
+        {0, 0, 0, 1}, {0, 1, 0, 1}, {0, 2, 0, 1}, {1, 0, 0, 1}, {1, 2, 0, 1}, {2, 0, 0, 1}, {2, 1, 0, 1}, {2, 2, 0, 1},
+    };
+};
+
+// the Jerusalem cube: 8 corner cubes of edge r = sqrt(2) - 1 and, between them, 12 cubes of edge r^2 = 1 - 2r in the
+// middle of the edges; the two sizes keep the ratio r at every level
+struct JerusalemRule
+{
+    static constexpr double R = 0.41421356237309504880;
+    static constexpr double R2 = 1.0 - 2.0 * R;
+    static constexpr int DIVISIONS = 1;
+    static constexpr int COUNT = 20;
+    static constexpr FractalCell CELLS[COUNT] = {
+        {0, 0, 0, R}, {0, 0, 1 - R, R}, {0, 1 - R, 0, R}, {0, 1 - R, 1 - R, R},
+        {1 - R, 0, 0, R}, {1 - R, 0, 1 - R, R}, {1 - R, 1 - R, 0, R}, {1 - R, 1 - R, 1 - R, R},
+        // along x, y and z
+        {R, 0, 0, R2}, {R, 0, 1 - R2, R2}, {R, 1 - R2, 0, R2}, {R, 1 - R2, 1 - R2, R2},
+        {0, R, 0, R2}, {0, R, 1 - R2, R2}, {1 - R2, R, 0, R2}, {1 - R2, R, 1 - R2, R2},
+        {0, 0, R, R2}, {0, 1 - R2, R, R2}, {1 - R2, 0, R, R2}, {1 - R2, 1 - R2, R, R2},
+    };
+};
+
+// the Mosely snowflake (lighter variant): 18 of the 3 x 3 x 3 sub-cubes, without the 8 corners and the centre
+struct MoselyRule
+{
+    static constexpr int DIVISIONS = 3;
+    static constexpr int COUNT = 18;
+    static constexpr FractalCell CELLS[COUNT] = {
+        {0, 0, 1, 1}, {0, 1, 0, 1}, {0, 1, 1, 1}, {0, 1, 2, 1}, {0, 2, 1, 1},
+        {1, 0, 0, 1}, {1, 0, 1, 1}, {1, 0, 2, 1}, {1, 1, 0, 1}, {1, 1, 2, 1}, {1, 2, 0, 1}, {1, 2, 1, 1}, {1, 2, 2, 1},
+        {2, 0, 1, 1}, {2, 1, 0, 1}, {2, 1, 1, 1}, {2, 1, 2, 1}, {2, 2, 1, 1},
+    };
+};
+
+// deepest level the templates are instantiated for
+const int FRACTAL_MAX_DEPTH = 8;
+
+// the 36 vertices of writeBox(), corner bits and texture coordinates
+struct FractalBoxVertex
+{
+    int x, y, z;
+    float u, v;
+};
+
+struct FractalBox
+{
+    static constexpr FractalBoxVertex VERTICES[MENGER_CUBE_VERTICES] = {
+        {0, 0, 0, 0.0f, 0.0f}, {1, 0, 0, 0.5f, 0.0f}, {0, 1, 0, 0.0f, 1.0f},
+        {0, 1, 0, 0.5f, 1.0f}, {1, 1, 0, 1.0f, 1.0f}, {1, 0, 0, 1.0f, 0.0f},
+        {0, 0, 1, 0.0f, 0.0f}, {1, 0, 1, 0.5f, 0.0f}, {0, 1, 1, 0.0f, 1.0f},
+        {0, 1, 1, 0.5f, 1.0f}, {1, 1, 1, 1.0f, 1.0f}, {1, 0, 1, 1.0f, 0.0f},
+        {0, 0, 1, 0.0f, 0.0f}, {0, 0, 0, 0.5f, 0.0f}, {0, 1, 1, 0.0f, 1.0f},
+        {0, 1, 1, 0.5f, 1.0f}, {0, 1, 0, 1.0f, 1.0f}, {0, 0, 0, 1.0f, 0.0f},
+        {1, 0, 1, 0.0f, 0.0f}, {1, 0, 0, 0.5f, 0.0f}, {1, 1, 1, 0.0f, 1.0f},
+        {1, 1, 1, 0.5f, 1.0f}, {1, 1, 0, 1.0f, 1.0f}, {1, 0, 0, 1.0f, 0.0f},
+        {0, 0, 0, 0.0f, 0.0f}, {1, 0, 0, 0.5f, 0.0f}, {0, 0, 1, 0.0f, 1.0f},
+        {0, 0, 1, 0.5f, 1.0f}, {1, 0, 1, 1.0f, 1.0f}, {1, 0, 0, 1.0f, 0.0f},
+        {0, 1, 0, 0.0f, 0.0f}, {1, 1, 0, 0.5f, 0.0f}, {0, 1, 1, 0.0f, 1.0f},
+        {0, 1, 1, 0.5f, 1.0f}, {1, 1, 1, 1.0f, 1.0f}, {1, 1, 0, 1.0f, 0.0f},
+    };
+
+    static float* write(float* cursor, float x, float y, float z, float width)
+    {
+        const float xs[2] = {x, x + width};
+        const float ys[2] = {y, y + width};
+        const float zs[2] = {z, z + width};
+        for (const FractalBoxVertex& v : VERTICES)
+        {
+            cursor[0] = xs[v.x];
+            cursor[1] = ys[v.y];
+            cursor[2] = zs[v.z];
+            cursor[3] = v.u;
+            cursor[4] = v.v;
+            cursor += MENGER_VERTEX_FLOATS;
+        }
+        return cursor;
+    }
+};
+
+// Depth levels of Rule below the cube (x, y, z, width); same arithmetic as menger(): the sub-cell unit in double,
+// positions rounded to float at every level; the children of a level are computed in a loop of their own before the
+// recursion (GCC 12 vectorized the fused loop without the rounding of the intermediate levels)
+template <typename Rule, int Depth>
+struct FractalLevel
+{
+    static float* write(float* cursor, float x, float y, float z, float width)
+    {
+        const double unit = width / (double)Rule::DIVISIONS;
+        float children[Rule::COUNT][4];
+        for (int n = 0; n < Rule::COUNT; n++)
+        {
+            children[n][0] = (float)(x + unit * Rule::CELLS[n].x);
+            children[n][1] = (float)(y + unit * Rule::CELLS[n].y);
+            children[n][2] = (float)(z + unit * Rule::CELLS[n].z);
+            children[n][3] = (float)(unit * Rule::CELLS[n].size);
+        }
+        for (const float* child : children)
+            cursor = FractalLevel<Rule, Depth - 1>::write(cursor, child[0], child[1], child[2], child[3]);
+        return cursor;
+    }
+};
+
+template <typename Rule>
+struct FractalLevel<Rule, 1>
+{
+    static float* write(float* cursor, float x, float y, float z, float width)
+    {
+        return FractalBox::write(cursor, x, y, z, width);
+    }
+};
+
+// picks the instantiation of a depth known only at run time; depth 1 - FRACTAL_MAX_DEPTH
+template <typename Rule, int Depth = FRACTAL_MAX_DEPTH>
+struct FractalDispatch
+{
+    static float* write(float* cursor, float x, float y, float z, float width, int depth)
+    {
+        if (depth == Depth)
+            return FractalLevel<Rule, Depth>::write(cursor, x, y, z, width);
+        return FractalDispatch<Rule, Depth - 1>::write(cursor, x, y, z, width, depth);
+    }
+};
+
+template <typename Rule>
+struct FractalDispatch<Rule, 0>
+{
+    static float* write(float* cursor, float, float, float, float, int)
+    {
+        return cursor;
+    }
+};
+
+enum FractalType
+{
+    FRACTAL_MENGER,
+    FRACTAL_CARPET,
+    FRACTAL_JERUSALEM,
+    FRACTAL_MOSELY,
+    FRACTAL_TYPE_COUNT
+};
+
+const char* fractalName(FractalType type);
+// number of cubes at the depth: COUNT^(depth-1)
+size_t fractalCubeCount(FractalType type, int depth);
+// allocates the exact output size once and writes all cubes; depth 1 - FRACTAL_MAX_DEPTH, other depths leave out empty
+void fractalGenerate(VertexData& out, FractalType type, float xpos, float ypos, float zpos, float width, int depth);
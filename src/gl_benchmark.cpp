@@ -0,0 +1,205 @@
+#include "gl_benchmark.h"
+#include "fly_camera.h"
+#include "gpu_sponge.h"
+#include "sponge_cache.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+// time to show a new depth: the visible faces generated by the compute shader where they are drawn from, against
+// mengerVisibleFaces() and the upload of its vertices; the vertex count written by the shader is checked against the
+// CPU one; printed to the console
+int benchmarkCompute(int computeProgram, int maxDepth)
+{
+    const int runs = 5;
+    printf("visible faces: compute shader vs CPU generator and upload, best of %d runs, times in ms\n", runs);
+    printf("%6s %12s %12s %12s %12s %12s %12s %8s\n", "depth", "CPU gen", "upload", "GPU gen", "GPU wall", "vertices",
+           "GPU vertices", "match");
+    for (int depth = 1; depth <= std::min(maxDepth, max_compute_depth); depth++)
+    {
+        double cpuMs = DBL_MAX, uploadMs = DBL_MAX, gpuMs = DBL_MAX, gpuWallMs = DBL_MAX;
+        size_t cpuVertices = 0, gpuVertices = 0;
+        for (int run = 0; run < runs; run++)
+        {
+            SpongeKey key;
+            key.depth = depth;
+            key.renderMode = RENDER_VERTICES;
+            key.geometryMode = GEOMETRY_VISIBLE_FACES;
+            SpongeGeometry geometry;
+            generateSponge(geometry, key, 0, NULL);
+            cpuMs = std::min(cpuMs, geometry.generationMs);
+            cpuVertices = geometry.vertices.vertexCount();
+            glFinish();
+            double start = glfwGetTime();
+            SpongeBuffers buffers;
+            uploadSponge(buffers, key, geometry);
+            streamSponge(buffers, geometry, DBL_MAX);
+            glFinish();
+            uploadMs = std::min(uploadMs, (glfwGetTime() - start) * 1000.0);
+            deleteSpongeBuffers(buffers);
+
+            ComputeSponge sponge;
+            start = glfwGetTime();
+            prepareComputeSponge(sponge, computeProgram, depth);
+            glFinish();
+            gpuWallMs = std::min(gpuWallMs, (glfwGetTime() - start) * 1000.0);
+            // the same depth again only reads the results back
+            prepareComputeSponge(sponge, computeProgram, depth);
+            gpuMs = std::min(gpuMs, sponge.generationMs);
+            gpuVertices = sponge.vertexCount;
+            deleteComputeSponge(sponge);
+        }
+        printf("%6d %12.3f %12.3f %12.3f %12.3f %12u %12u %8s\n", depth, cpuMs, uploadMs, gpuMs, gpuWallMs,
+               (unsigned int)cpuVertices, (unsigned int)gpuVertices, cpuVertices == gpuVertices ? "yes" : "NO");
+    }
+    return 0;
+}
+
+// GPU time of a frame and memory of the sponge at every depth: the vertex buffer of the visible faces against ray
+// marching and the voxel traversal, in the view of the window turned by 30 and 40 degrees; then the fly-through
+// camera diving at a wall, with the frame time at every depth of its root; printed to the console
+int benchmarkRaymarch(GLFWwindow* window, int rasterProgram, int raymarchProgram, int voxelProgram, int flyProgram,
+                      unsigned int emptyVAO, const glm::mat4& projection, int maxDepth)
+{
+    const int frames = 20;
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(30.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(40.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -6.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+
+    unsigned int timer;
+    glGenQueries(1, &timer);
+    // milliseconds of a frame averaged: GPU time of the draw (GL_TIME_ELAPSED) and wall time until glFinish()
+    // returns, which also holds on drivers whose timer only covers the submission
+    auto timeFrames = [&](int program, const SpongeBuffers* buffers, double& wallMs)
+    {
+        double total = 0.0;
+        wallMs = 0.0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glUseProgram(program);
+            glFinish();
+            double start = glfwGetTime();
+            glBeginQuery(GL_TIME_ELAPSED, timer);
+            if (buffers != NULL)
+            {
+                drawSponge(*buffers, NULL);
+            }
+            else
+            {
+                glBindVertexArray(emptyVAO);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            glEndQuery(GL_TIME_ELAPSED);
+            glFinish();
+            wallMs += (glfwGetTime() - start) * 1000.0;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(timer, GL_QUERY_RESULT, &nanoseconds);
+            total += nanoseconds / 1e6;
+            glfwSwapBuffers(window);
+        }
+        wallMs /= frames;
+        return total / frames;
+    };
+
+    glUseProgram(rasterProgram);
+    glUniformMatrix4fv(glGetUniformLocation(rasterProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(glGetUniformLocation(rasterProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(rasterProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3f(glGetUniformLocation(rasterProgram, "color"), 1.0f, 1.0f, 1.0f);
+    glUseProgram(raymarchProgram);
+    glUniform3f(glGetUniformLocation(raymarchProgram, "color"), 1.0f, 1.0f, 1.0f);
+    glUseProgram(voxelProgram);
+    glUniform3f(glGetUniformLocation(voxelProgram, "color"), 1.0f, 1.0f, 1.0f);
+    VoxelOccupancy occupancy;
+
+    // ray marching reads no buffer, it has no memory column
+    printf("ray marching and voxel traversal vs vertex buffer of visible faces, %d x %d, %d frames each, times in ms\n",
+           framebufferWidth, framebufferHeight, frames);
+    printf("%6s %12s %12s %12s %12s %12s %12s %12s %12s\n", "depth", "raster GPU", "raster wall", "raster MB",
+           "march GPU", "march wall", "voxel GPU", "voxel wall", "voxel KB");
+    for (int depth = 1; depth <= std::min(maxDepth, MAX_RAYMARCH_DEPTH); depth++)
+    {
+        glUseProgram(raymarchProgram);
+        setRaymarchUniforms(raymarchProgram, projection * view * model, framebufferWidth, framebufferHeight, depth);
+        double raymarchWallMs;
+        double raymarchMs = timeFrames(raymarchProgram, NULL, raymarchWallMs);
+        char voxel[3][16] = {"-", "-", "-"};
+        if (depth <= MAX_VOXEL_DEPTH)
+        {
+            glUseProgram(voxelProgram);
+            setRaymarchUniforms(voxelProgram, projection * view * model, framebufferWidth, framebufferHeight, depth);
+            prepareVoxelOccupancy(occupancy, depth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_BUFFER, occupancy.texture);
+            glActiveTexture(GL_TEXTURE0);
+            double voxelWallMs;
+            double voxelMs = timeFrames(voxelProgram, NULL, voxelWallMs);
+            snprintf(voxel[0], sizeof(voxel[0]), "%.3f", voxelMs);
+            snprintf(voxel[1], sizeof(voxel[1]), "%.3f", voxelWallMs);
+            snprintf(voxel[2], sizeof(voxel[2]), "%.2f", occupancy.bytes / 1024.0);
+        }
+        if (depth > MAX_GENERATED_DEPTH)
+        {
+            printf("%6d %12s %12s %12s %12.3f %12.3f %12s %12s %12s\n", depth, "-", "-", "-", raymarchMs,
+                   raymarchWallMs, voxel[0], voxel[1], voxel[2]);
+            continue;
+        }
+
+        SpongeKey key;
+        key.depth = depth;
+        key.renderMode = RENDER_VERTICES;
+        key.geometryMode = GEOMETRY_VISIBLE_FACES;
+        SpongeGeometry geometry;
+        generateSponge(geometry, key, 0, NULL);
+        SpongeBuffers buffers;
+        uploadSponge(buffers, key, geometry);
+        streamSponge(buffers, geometry, DBL_MAX);
+        double rasterWallMs;
+        double rasterMs = timeFrames(rasterProgram, &buffers, rasterWallMs);
+        printf("%6d %12.3f %12.3f %12.1f %12.3f %12.3f %12s %12s %12s\n", depth, rasterMs, rasterWallMs,
+               buffers.vertexBytes / (1024.0 * 1024.0), raymarchMs, raymarchWallMs, voxel[0], voxel[1], voxel[2]);
+        deleteSpongeBuffers(buffers);
+    }
+    deleteVoxelOccupancy(occupancy);
+
+    // the camera moves half its distance to the wall ahead at a time; the coordinates of the shader and the work of
+    // a move and of a frame should not change with the depth
+    printf("\nfly-through: camera diving at a wall, %d frames per root level, times in ms\n", frames);
+    printf("%6s %8s %12s %12s %12s %12s %12s\n", "root", "moves", "move us", "distance", "camera level", "fly GPU",
+           "fly wall");
+    glUseProgram(flyProgram);
+    glUniform3f(glGetUniformLocation(flyProgram, "color"), 1.0f, 1.0f, 1.0f);
+    FlyCamera camera;
+    camera.turn(0.12, 0.07);
+    const int roots[] = {0, 1, 2, 4, 8, 16, 24, 32, FlyCamera::MAX_ROOT_LEVEL};
+    int moves = 0;
+    for (int root : roots)
+    {
+        int rootMoves = 0;
+        double start = glfwGetTime();
+        while (camera.rootLevel() < root && rootMoves < 10000)
+        {
+            camera.move(1.0, 0.0, 0.0);
+            rootMoves++;
+        }
+        double moveUs = rootMoves > 0 ? (glfwGetTime() - start) * 1e6 / rootMoves : 0.0;
+        moves += rootMoves;
+        glUseProgram(flyProgram);
+        setFlyUniforms(flyProgram, camera, framebufferWidth, framebufferHeight);
+        double flyWallMs;
+        double flyMs = timeFrames(flyProgram, NULL, flyWallMs);
+        printf("%6d %8d %12.2f %12.4f %12.2f %12.3f %12.3f\n", camera.rootLevel(), moves, moveUs, camera.distance(),
+               camera.scaleLevel(), flyMs, flyWallMs);
+    }
+    glDeleteQueries(1, &timer);
+    return 0;
+}
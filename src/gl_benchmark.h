@@ -0,0 +1,13 @@
+// GPU benchmarks of the sponge modes, run with: OpenGLPAG --benchmark-raymarch [max depth] or
+// OpenGLPAG --benchmark-compute [max depth]
+// They draw into the window of the application and need its OpenGL context, with the programs already built.
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+struct GLFWwindow;
+
+int benchmarkRaymarch(GLFWwindow* window, int rasterProgram, int raymarchProgram, int voxelProgram, int flyProgram,
+                      unsigned int emptyVAO, const glm::mat4& projection, int maxDepth);
+int benchmarkCompute(int computeProgram, int maxDepth);
@@ -0,0 +1,191 @@
+#include "gpu_sponge.h"
+#include "menger.h"
+#include "sponge_cache.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// matrices, viewport and sponge of the ray marching program, which is bound
+void setRaymarchUniforms(int program, const glm::mat4& matrix, int framebufferWidth, int framebufferHeight, int depth)
+{
+    glUniformMatrix4fv(glGetUniformLocation(program, "matrix"), 1, GL_FALSE, glm::value_ptr(matrix));
+    glUniformMatrix4fv(glGetUniformLocation(program, "inverseMatrix"), 1, GL_FALSE,
+                       glm::value_ptr(glm::inverse(matrix)));
+    glUniform2f(glGetUniformLocation(program, "viewport"), (float)framebufferWidth, (float)framebufferHeight);
+    // in units of the [-1, 1] sponge, as the march measures its distances
+    float pixelAngle = 2.0f * std::tan(glm::radians(45.0f) / 2.0f) / std::max(framebufferHeight, 1);
+    glUniform1f(glGetUniformLocation(program, "pixelAngle"), pixelAngle);
+    glUniform4f(glGetUniformLocation(program, "sponge"), SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH);
+    glUniform1i(glGetUniformLocation(program, "depth"), depth);
+}
+
+// levels below the root cell evaluated per pixel: down to the holes of a pixel
+int carpetLevels(const CarpetView& view, int framebufferHeight)
+{
+    double pixel = view.viewHeight() / std::max(framebufferHeight, 1);
+    int levels = (int)std::floor(std::log(1.0 / pixel) / std::log(3.0));
+    return std::min(std::max(levels, 0), CarpetView::ROOT_LEVELS + 12);
+}
+
+// view of the carpet program, which is bound; the centre is split into a float and the float of its remainder
+void setCarpetUniforms(int program, const CarpetView& view, int framebufferWidth, int framebufferHeight)
+{
+    float x = (float)view.centerX(), y = (float)view.centerY();
+    glUniform2f(glGetUniformLocation(program, "viewport"), (float)framebufferWidth, (float)framebufferHeight);
+    glUniform4f(glGetUniformLocation(program, "center"), x, y, (float)(view.centerX() - x),
+                (float)(view.centerY() - y));
+    glUniform1f(glGetUniformLocation(program, "pixelSize"), (float)(view.viewHeight() / std::max(framebufferHeight, 1)));
+    glUniform1i(glGetUniformLocation(program, "rootMask"), view.rootMask());
+    glUniform1i(glGetUniformLocation(program, "levels"), carpetLevels(view, framebufferHeight));
+}
+
+// camera and neighbourhood of the fly-through program, which is bound
+void setFlyUniforms(int program, const FlyCamera& camera, int framebufferWidth, int framebufferHeight)
+{
+    double forward[3], right[3], up[3];
+    camera.basis(forward, right, up);
+    const glm::mat3 axes(glm::vec3(right[0], right[1], right[2]), glm::vec3(up[0], up[1], up[2]),
+                         glm::vec3(forward[0], forward[1], forward[2]));
+    const double* eye = camera.eye();
+    float tanHalfFov = std::tan(glm::radians(45.0f) / 2.0f);
+    float pixelAngle = 2.0f * tanHalfFov / std::max(framebufferHeight, 1);
+    // holes down to a pixel at the distance of the nearest wall
+    int levels = (int)std::ceil(std::log(1.0 / (camera.distance() * pixelAngle)) / std::log(3.0)) + 1;
+    glUniform2f(glGetUniformLocation(program, "viewport"), (float)framebufferWidth, (float)framebufferHeight);
+    glUniform3f(glGetUniformLocation(program, "eye"), (float)eye[0], (float)eye[1], (float)eye[2]);
+    glUniformMatrix3fv(glGetUniformLocation(program, "camera"), 1, GL_FALSE, glm::value_ptr(axes));
+    glUniform1f(glGetUniformLocation(program, "tanHalfFov"), tanHalfFov);
+    glUniform1f(glGetUniformLocation(program, "pixelAngle"), pixelAngle);
+    glUniform1i(glGetUniformLocation(program, "rootMask"), camera.rootMask());
+    glUniform1i(glGetUniformLocation(program, "levels"), std::min(std::max(levels, 1), FlyCamera::MAX_CELL_LEVELS));
+    glUniform1f(glGetUniformLocation(program, "tileLevel"),
+                (float)std::max(camera.scaleLevel() - camera.rootLevel() + 2.0, 1.0));
+    // the whole sponge is in view from the root of level 0, deeper ones end a root cell past their neighbours
+    glUniform1f(glGetUniformLocation(program, "fogDistance"), camera.rootLevel() > 0 ? 2.0f : 0.0f);
+}
+
+void prepareVoxelOccupancy(VoxelOccupancy& occupancy, int depth)
+{
+    if (occupancy.depth == depth)
+        return;
+    if (occupancy.texture == 0)
+    {
+        glGenBuffers(1, &occupancy.buffer);
+        glGenTextures(1, &occupancy.texture);
+    }
+    std::vector<unsigned int> nodes;
+    mengerOccupancy(nodes, depth);
+    glBindBuffer(GL_TEXTURE_BUFFER, occupancy.buffer);
+    glBufferData(GL_TEXTURE_BUFFER, nodes.size() * sizeof(unsigned int), nodes.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, occupancy.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, occupancy.buffer);
+    glActiveTexture(GL_TEXTURE0);
+    occupancy.depth = depth;
+    occupancy.bytes = nodes.size() * sizeof(unsigned int);
+}
+
+void deleteVoxelOccupancy(VoxelOccupancy& occupancy)
+{
+    glDeleteTextures(1, &occupancy.texture);
+    glDeleteBuffers(1, &occupancy.buffer);
+    occupancy = VoxelOccupancy();
+}
+
+// vertex buffer of the visible faces of a depth, the exact size the compute shader fills
+size_t computeVertexBytes(int depth)
+{
+    return mengerVisibleFaceCount(depth) * 6 * MENGER_VERTEX_FLOATS * sizeof(float);
+}
+
+// deepest sponge, at most that of the CPU modes, whose vertices fit in one shader storage block
+int computeDepthLimit()
+{
+    GLint64 blockBytes = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &blockBytes);
+    int depth = MAX_GENERATED_DEPTH;
+    while (depth > 1 && computeVertexBytes(depth) > (size_t)blockBytes)
+        depth--;
+    return depth;
+}
+
+// picks up the results of the last generation once the GPU has them, and dispatches a new one when the depth changed;
+// nothing is generated or sent by the CPU, the buffer is only allocated with its known size
+void prepareComputeSponge(ComputeSponge& sponge, int program, int depth)
+{
+    if (sponge.timing)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(sponge.timer, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(sponge.timer, GL_QUERY_RESULT, &nanoseconds);
+            sponge.generationMs = nanoseconds / 1e6;
+            // the shader has finished with the command, reading its first field does not stall
+            GLuint vertexCount = 0;
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sponge.command);
+            glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(vertexCount), &vertexCount);
+            sponge.vertexCount = vertexCount;
+            sponge.timing = false;
+        }
+    }
+    if (sponge.depth == depth)
+        return;
+
+    if (sponge.VAO == 0)
+    {
+        glGenVertexArrays(1, &sponge.VAO);
+        glGenBuffers(1, &sponge.VBO);
+        glGenBuffers(1, &sponge.command);
+        glGenQueries(1, &sponge.timer);
+        glBindVertexArray(sponge.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, sponge.VBO);
+        setVertexAttributes();
+    }
+    sponge.vertexBytes = computeVertexBytes(depth);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sponge.VBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sponge.vertexBytes, NULL, GL_DYNAMIC_COPY);
+    // vertex count, instance count, first vertex, base instance
+    const GLuint command[4] = {0, 1, 0, 0};
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sponge.command);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sponge.VBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sponge.command);
+
+    const long size = mengerLatticeSize(depth);
+    const GLuint groups = (GLuint)((size + 3) / 4);
+    glUseProgram(program);
+    glUniform4f(glGetUniformLocation(program, "sponge"), SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH);
+    glUniform1i(glGetUniformLocation(program, "size"), (int)size);
+    glBeginQuery(GL_TIME_ELAPSED, sponge.timer);
+    glDispatchCompute(groups, groups, groups);
+    glEndQuery(GL_TIME_ELAPSED);
+    // the draws fetch the vertices and the command the shader wrote, glGetBufferSubData() reads back the count
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    sponge.depth = depth;
+    sponge.vertexCount = 0;
+    sponge.timing = true;
+}
+
+// the vertex count stays on the GPU, in the command
+void drawComputeSponge(const ComputeSponge& sponge)
+{
+    glBindVertexArray(sponge.VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sponge.command);
+    glDrawArraysIndirect(GL_TRIANGLES, (void*)0);
+}
+
+void deleteComputeSponge(ComputeSponge& sponge)
+{
+    glDeleteQueries(1, &sponge.timer);
+    glDeleteVertexArrays(1, &sponge.VAO);
+    glDeleteBuffers(1, &sponge.VBO);
+    glDeleteBuffers(1, &sponge.command);
+    sponge = ComputeSponge();
+}
@@ -0,0 +1,49 @@
+// Sponges drawn without CPU generated geometry
+// The ray marching, voxel traversal, carpet and fly-through modes evaluate the sponge for every pixel in their fragment
+// shaders, from a few uniforms and, for the voxel traversal, the 27-tree of mengerOccupancy() in a buffer texture on
+// unit 1. RENDER_COMPUTE generates the visible faces into a vertex buffer with a compute shader and draws them with the
+// vertex count the shader wrote. The programs are built by the caller and bound while their uniforms are set.
+
+#pragma once
+
+#include "carpet_view.h"
+#include "fly_camera.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// 27-tree of mengerOccupancy() in a buffer texture, rebuilt when the depth changes
+struct VoxelOccupancy
+{
+    int depth = -1;
+    unsigned int buffer = 0, texture = 0;
+    size_t bytes = 0;
+};
+
+// RENDER_COMPUTE: the vertex buffer the compute shader appends the visible faces to and the glDrawArraysIndirect
+// command it counts them in, regenerated when the depth changes; the vertex count and the GPU time of a generation
+// are read back once its timer query has finished, without waiting for it
+struct ComputeSponge
+{
+    int depth = -1;
+    unsigned int VAO = 0, VBO = 0;
+    unsigned int command = 0; // GL_DRAW_INDIRECT_BUFFER
+    unsigned int timer = 0;
+    bool timing = false;
+    size_t vertexBytes = 0;
+    size_t vertexCount = 0;
+    double generationMs = 0.0;
+};
+
+void setRaymarchUniforms(int program, const glm::mat4& matrix, int framebufferWidth, int framebufferHeight, int depth);
+int carpetLevels(const CarpetView& view, int framebufferHeight);
+void setCarpetUniforms(int program, const CarpetView& view, int framebufferWidth, int framebufferHeight);
+void setFlyUniforms(int program, const FlyCamera& camera, int framebufferWidth, int framebufferHeight);
+void prepareVoxelOccupancy(VoxelOccupancy& occupancy, int depth);
+void deleteVoxelOccupancy(VoxelOccupancy& occupancy);
+size_t computeVertexBytes(int depth);
+int computeDepthLimit();
+void prepareComputeSponge(ComputeSponge& sponge, int program, int depth);
+void drawComputeSponge(const ComputeSponge& sponge);
+void deleteComputeSponge(ComputeSponge& sponge);
@@ -7,7 +7,18 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "carpet_view.h"
+#include "fly_camera.h"
+#include "gl_benchmark.h"
+#include "gpu_sponge.h"
+#include "menger.h"
+#include "menger_lod.h"
+#include "occlusion_raster.h"
+#include "benchmark.h"
+#include "process_memory.h"
+#include "sponge_cache.h"
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 
 // About OpenGL function loaders: modern OpenGL doesn't have a standard header file and requires individual function pointers to be loaded manually.
@@ -29,34 +40,125 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 
 GLFWwindow* initializeWindow();
-int buildVertexShader();
-int buildFragmentShader();
+int buildVertexShader(const char* source);
+int buildFragmentShader(const char* source);
 int linkShaders(int vertexShader, int fragmentShader);
-void fillVertexBuffer();
+int buildProgram(const char* vertexSource, const char* fragmentSource);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
-void calculateBox(float x, float y, float z, float width);
-void menger(float xpos, float ypos, float zpos, float width, int depth);
+bool hasExtension(const char* name);
 
 // settings
 const unsigned int SCR_WIDTH = 900;
 const unsigned int SCR_HEIGHT = 900;
-std::vector<float> vertices = {};
+
+// how the cells hidden behind the sponge itself are left out
+enum OcclusionMode
+{
+    OCCLUSION_NONE,
+    OCCLUSION_QUERIES, // GPU queries of blocks, one frame late
+    OCCLUSION_SOFTWARE // CPU depth rasterizer, before the draw calls
+};
+// GPU queries group the cells into blocks, the sub-trees this many levels below the whole sponge (400 blocks)
+const int OCCLUSION_BLOCK_LEVELS = 2;
+// the CPU rasterizer: buffer width (the height follows the window), largest occluders drawn into it, and the deepest
+// sponge whose greedy rectangles are used; deeper sponges take the rectangles of this depth, whose missing holes are
+// under a pixel of the buffer
+const int SOFTWARE_OCCLUSION_WIDTH = 320;
+const size_t MAX_OCCLUDERS = 16384;
+const int MAX_OCCLUDER_DEPTH = MAX_GENERATED_DEPTH;
+
+// occlusion culling: the bounding box of every block is tested with a GL_ANY_SAMPLES_PASSED query against the depth
+// of a finished frame, and the next frame draws the block under glBeginConditionalRender() with that query
+struct OcclusionBlocks
+{
+    int levels = -1;
+    SpongeBuffers boxes; // unit cube and one (x, y, z, width) instance per block
+    std::vector<unsigned int> queries;
+    std::vector<char> queried; // the query of the block was issued after the last frame
+    std::vector<std::vector<MengerCellRange> > cells; // visible cells of every block in this frame
+};
+
+// software occlusion culling: occluders and cell boxes are kept until the depth or the cell levels change
+struct SoftwareOcclusion
+{
+    OcclusionRaster raster;
+    int occluderDepth = -1;
+    std::vector<float> occluders;
+    int cellLevels = -1;
+    VertexData cellBoxes; // (x, y, z, width) of every cell
+    std::vector<char> visible;
+};
+
+SpongeKey currentSpongeKey();
+size_t drawProcedural(GLint firstInstanceLoc, int depth, const std::vector<MengerCellRange>* ranges);
+size_t drawCells(const SpongeBuffers* buffers, GLint firstInstanceLoc, int depth,
+                 const std::vector<MengerCellRange>* ranges);
+void prepareOcclusionBlocks(OcclusionBlocks& blocks, int levels);
+void deleteOcclusionBlocks(OcclusionBlocks& blocks);
+size_t drawOccluded(OcclusionBlocks& blocks, const SpongeBuffers* buffers, GLint firstInstanceLoc, int depth,
+                    int cellLevels, const std::vector<MengerCellRange>& ranges);
+void queryOcclusionBlocks(OcclusionBlocks& blocks);
+void cullOccludedCells(SoftwareOcclusion& occlusion, std::vector<MengerCellRange>& ranges, int depth, int cellLevels,
+                       const glm::mat4& matrix, int framebufferWidth, int framebufferHeight);
+void showMemoryPanel(size_t textureBytes, const SpongeBuffers& lodBuffers, const VoxelOccupancy& voxels,
+                     const ComputeSponge& compute);
+void updateCarpetView(CarpetView& view, double seconds);
+void updateFlyCamera(GLFWwindow* window, FlyCamera& camera, double seconds);
+int buildComputeProgram(const char* source);
+MengerFrustum frustumOf(const glm::mat4& matrix);
+void createLodBuffers(SpongeBuffers& buffers);
+void uploadLodCubes(SpongeBuffers& buffers, const MengerLod& lod);
+
+static bool compact_vertices = false;
+static bool use_32bit_indices = false;
+// vertex shader invocations of the last finished sponge draw (GL_ARB_pipeline_statistics_query)
+static bool has_pipeline_statistics = false;
+GLuint64 vertex_invocations = 0;
 static int max_depth = 3;
+static int render_mode = RENDER_VERTICES;
+static int geometry_mode = GEOMETRY_VISIBLE_FACES;
+// RENDER_LOD: allowed error of the cut in pixels, its size limits and the time of its last update
+static float lod_pixel_error = 1.0f;
+static int lod_max_cubes = 262144;
+static int lod_splits_per_frame = 4096;
+double lod_update_ms = 0.0;
+// visible cells of the drawn sponge and the triangles drawn of them in the last frame
+static bool frustum_culling = true;
+MengerCullStats cull_stats;
+size_t drawn_triangles = 0;
+// OCCLUSION_QUERIES: blocks whose boxes were queried after the last frame, and how many of them were hidden (counted
+// from the results of the frame before, read only once the GPU has them); OCCLUSION_SOFTWARE: cells tested and hidden
+// in this frame, and the time of the rasterization and of the tests
+static int occlusion_mode = OCCLUSION_NONE;
+int drawn_cell_levels = -1; // cell levels of the last drawn sponge, -1 when it had no cells
+size_t occlusion_tested = 0;
+size_t occlusion_hidden = 0;
+double occlusion_raster_ms = 0.0;
+double occlusion_test_ms = 0.0;
 ImVec4 clear_color = ImVec4(0.5f, 0.5f, 0.5f, 1.0f);
 float radiusX = 0;
 float radiusY = 0;
+// RENDER_CARPET: the view, and its zoom towards the centre by this factor per second when on
+CarpetView carpet_view;
+static bool carpet_auto_zoom = false;
+static float carpet_zoom_speed = 2.0f;
+// RENDER_FLY: the camera, and its speed in distances to the nearest wall per second
+FlyCamera fly_camera;
+static float fly_speed = 1.0f;
 
 const char *vertexShaderSource ="#version 330 core\n"
                                 "layout (location = 0) in vec3 aPos;\n"
-                                "layout (location = 1) in vec3 aColor;\n"
                                 "layout (location = 2) in vec2 aTexCoord;\n"
-                                "out vec3 ourColor;\n"
                                 "out vec2 TexCoord;\n"
                                 "uniform mat4 model;\n"
                                 "uniform mat4 view;\n"
@@ -64,27 +166,556 @@ const char *vertexShaderSource ="#version 330 core\n"
                                 "void main()\n"
                                 "{\n"
                                 "   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
-                                "   ourColor = aColor;\n"
                                 "   TexCoord = aTexCoord;\n"
                                 "}\0";
 
 const char *fragmentShaderSource = "#version 330 core\n"
-                                   "in vec3 ourColor;\n"
                                    "in vec2 TexCoord;\n"
                                    "out vec4 FragColor;\n"
                                    "uniform sampler2D ourTexture;\n"
+                                   "uniform vec3 color;\n"
                                    "void main()\n"
                                    "{\n"
-                                   "   FragColor = texture(ourTexture, TexCoord) * vec4(ourColor, 1.0f);\n"
+                                   "   FragColor = texture(ourTexture, TexCoord) * vec4(color, 1.0f);\n"
                                    "}\n\0";
 
+// unit cube scaled and moved by the per-instance attribute
+const char *instancedVertexShaderSource ="#version 330 core\n"
+                                         "layout (location = 0) in vec3 aPos;\n"
+                                         "layout (location = 2) in vec2 aTexCoord;\n"
+                                         "layout (location = 3) in vec4 aInstance;\n" // xyz - cube origin, w - width
+                                         "out vec2 TexCoord;\n"
+                                         "uniform mat4 model;\n"
+                                         "uniform mat4 view;\n"
+                                         "uniform mat4 projection;\n"
+                                         "void main()\n"
+                                         "{\n"
+                                         "   gl_Position = projection * view * model * vec4(aInstance.xyz + aPos * aInstance.w, 1.0);\n"
+                                         "   TexCoord = aTexCoord;\n"
+                                         "}\0";
+
+// compact vertices: lattice corner and normalized texture coordinates, position restored from the uniforms
+const char *compactVertexShaderSource ="#version 330 core\n"
+                                       "layout (location = 0) in vec3 aLattice;\n"
+                                       "layout (location = 2) in vec2 aTexCoord;\n"
+                                       "out vec2 TexCoord;\n"
+                                       "uniform mat4 model;\n"
+                                       "uniform mat4 view;\n"
+                                       "uniform mat4 projection;\n"
+                                       "uniform vec4 lattice;\n" // xyz - sponge origin, w - lattice cell width
+                                       "void main()\n"
+                                       "{\n"
+                                       "   gl_Position = projection * view * model * vec4(lattice.xyz + aLattice * lattice.w, 1.0);\n"
+                                       "   TexCoord = aTexCoord;\n"
+                                       "}\0";
+
+// no vertex data at all: the cube comes from gl_InstanceID and the corner from gl_VertexID
+const char *proceduralVertexShaderSource ="#version 330 core\n"
+                                          "out vec2 TexCoord;\n"
+                                          "uniform mat4 model;\n"
+                                          "uniform mat4 view;\n"
+                                          "uniform mat4 projection;\n"
+                                          "uniform vec4 sponge;\n"
+                                          "uniform int depth;\n"
+                                          "uniform int firstInstance;\n" // first cube of a range left by frustum culling
+                                          "const vec3 SUBCUBES[20] = vec3[20](\n"
+                                          "   vec3(0, 0, 0), vec3(0, 0, 1), vec3(0, 0, 2), vec3(0, 1, 0), vec3(0, 1, 2), vec3(0, 2, 0), vec3(0, 2, 1), vec3(0, 2, 2),\n"
+                                          "   vec3(1, 0, 0), vec3(1, 0, 2), vec3(1, 2, 0), vec3(1, 2, 2),\n"
+                                          "   vec3(2, 0, 0), vec3(2, 0, 1), vec3(2, 0, 2), vec3(2, 1, 0), vec3(2, 1, 2), vec3(2, 2, 0), vec3(2, 2, 1), vec3(2, 2, 2));\n"
+                                          "const vec3 CORNERS[36] = vec3[36](\n"
+                                          "   vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 1, 0), vec3(1, 1, 0), vec3(1, 0, 0),\n"
+                                          "   vec3(0, 0, 1), vec3(1, 0, 1), vec3(0, 1, 1), vec3(0, 1, 1), vec3(1, 1, 1), vec3(1, 0, 1),\n"
+                                          "   vec3(0, 0, 1), vec3(0, 0, 0), vec3(0, 1, 1), vec3(0, 1, 1), vec3(0, 1, 0), vec3(0, 0, 0),\n"
+                                          "   vec3(1, 0, 1), vec3(1, 0, 0), vec3(1, 1, 1), vec3(1, 1, 1), vec3(1, 1, 0), vec3(1, 0, 0),\n"
+                                          "   vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 0, 1), vec3(0, 0, 1), vec3(1, 0, 1), vec3(1, 0, 0),\n"
+                                          "   vec3(0, 1, 0), vec3(1, 1, 0), vec3(0, 1, 1), vec3(0, 1, 1), vec3(1, 1, 1), vec3(1, 1, 0));\n"
+                                          "const vec2 UVS[36] = vec2[36](\n"
+                                          "   vec2(0, 0), vec2(0.5, 0), vec2(0, 1), vec2(0.5, 1), vec2(1, 1), vec2(1, 0),\n"
+                                          "   vec2(0, 0), vec2(0.5, 0), vec2(0, 1), vec2(0.5, 1), vec2(1, 1), vec2(1, 0),\n"
+                                          "   vec2(0, 0), vec2(0.5, 0), vec2(0, 1), vec2(0.5, 1), vec2(1, 1), vec2(1, 0),\n"
+                                          "   vec2(0, 0), vec2(0.5, 0), vec2(0, 1), vec2(0.5, 1), vec2(1, 1), vec2(1, 0),\n"
+                                          "   vec2(0, 0), vec2(0.5, 0), vec2(0, 1), vec2(0.5, 1), vec2(1, 1), vec2(1, 0),\n"
+                                          "   vec2(0, 0), vec2(0.5, 0), vec2(0, 1), vec2(0.5, 1), vec2(1, 1), vec2(1, 0));\n"
+                                          "void main()\n"
+                                          "{\n"
+                                          "   // base-20 digits of the instance id, finest level first, give the cube position in lattice cells\n"
+                                          "   int index = gl_InstanceID + firstInstance;\n"
+                                          "   vec3 cell = vec3(0.0);\n"
+                                          "   float scale = 1.0;\n"
+                                          "   for (int level = 1; level < depth; level++)\n"
+                                          "   {\n"
+                                          "      cell += SUBCUBES[index % 20] * scale;\n"
+                                          "      index /= 20;\n"
+                                          "      scale *= 3.0;\n"
+                                          "   }\n"
+                                          "   vec3 aPos = sponge.xyz + (cell + CORNERS[gl_VertexID]) * (sponge.w / scale);\n"
+                                          "   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+                                          "   TexCoord = UVS[gl_VertexID];\n"
+                                          "}\0";
+
+// one triangle covering the screen, corners from gl_VertexID
+const char *raymarchVertexShaderSource ="#version 330 core\n"
+                                        "void main()\n"
+                                        "{\n"
+                                        "   vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+                                        "   gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);\n"
+                                        "}\0";
+
+// sphere tracing of the signed distance of the sponge (the cube minus the cross-shaped holes of every level, in
+// coordinates where the sponge is [-1, 1]^3); the stone texture is projected along the three axes and blended by the
+// normal, one tile per finest cube as in the triangle modes
+const char *raymarchFragmentShaderSource = "#version 330 core\n"
+                                           "out vec4 FragColor;\n"
+                                           "uniform sampler2D ourTexture;\n"
+                                           "uniform vec3 color;\n"
+                                           "uniform mat4 matrix;\n" // projection * view * model
+                                           "uniform mat4 inverseMatrix;\n"
+                                           "uniform vec2 viewport;\n"
+                                           "uniform float pixelAngle;\n" // size of a pixel at distance 1
+                                           "uniform vec4 sponge;\n"
+                                           "uniform int depth;\n"
+                                           "const int MAX_STEPS = 256;\n"
+                                           "float spongeDistance(vec3 p)\n"
+                                           "{\n"
+                                           "   vec3 outside = abs(p) - vec3(1.0);\n"
+                                           "   float d = min(max(outside.x, max(outside.y, outside.z)), 0.0) + length(max(outside, 0.0));\n"
+                                           "   float scale = 1.0;\n"
+                                           "   for (int level = 1; level < depth; level++)\n"
+                                           "   {\n"
+                                           "      vec3 a = mod(p * scale, 2.0) - 1.0;\n"
+                                           "      scale *= 3.0;\n"
+                                           "      vec3 r = abs(1.0 - 3.0 * abs(a));\n"
+                                           "      float hole = min(max(r.x, r.y), min(max(r.y, r.z), max(r.z, r.x))) - 1.0;\n"
+                                           "      d = max(d, hole / scale);\n"
+                                           "   }\n"
+                                           "   return d;\n"
+                                           "}\n"
+                                           "void main()\n"
+                                           "{\n"
+                                           "   vec2 ndc = gl_FragCoord.xy / viewport * 2.0 - 1.0;\n"
+                                           "   vec4 nearPoint = inverseMatrix * vec4(ndc, -1.0, 1.0);\n"
+                                           "   vec4 farPoint = inverseMatrix * vec4(ndc, 1.0, 1.0);\n"
+                                           "   float halfWidth = sponge.w * 0.5;\n"
+                                           "   vec3 center = sponge.xyz + vec3(halfWidth);\n"
+                                           "   vec3 origin = (nearPoint.xyz / nearPoint.w - center) / halfWidth;\n"
+                                           "   vec3 direction = normalize(farPoint.xyz / farPoint.w - nearPoint.xyz / nearPoint.w);\n"
+                                           // the march starts where the ray enters the bounding cube
+                                           "   vec3 inverseDirection = 1.0 / direction;\n"
+                                           "   vec3 t0 = (-1.0 - origin) * inverseDirection, t1 = (1.0 - origin) * inverseDirection;\n"
+                                           "   vec3 tMin = min(t0, t1), tMax = max(t0, t1);\n"
+                                           "   float t = max(max(max(tMin.x, tMin.y), tMin.z), 0.0);\n"
+                                           "   float tExit = min(min(tMax.x, tMax.y), tMax.z);\n"
+                                           "   if (t > tExit)\n"
+                                           "      discard;\n"
+                                           "   float epsilon = 0.0;\n"
+                                           "   bool hit = false;\n"
+                                           "   for (int step = 0; step < MAX_STEPS && t <= tExit; step++)\n"
+                                           "   {\n"
+                                           "      float d = spongeDistance(origin + direction * t);\n"
+                                           "      epsilon = max(pixelAngle * t * 0.5, 1e-6);\n"
+                                           "      if (d < epsilon)\n"
+                                           "      {\n"
+                                           "         hit = true;\n"
+                                           "         break;\n"
+                                           "      }\n"
+                                           "      t += d;\n"
+                                           "   }\n"
+                                           "   if (!hit)\n"
+                                           "      discard;\n"
+                                           "   vec3 p = origin + direction * t;\n"
+                                           "   vec2 e = vec2(epsilon, 0.0);\n"
+                                           "   vec3 normal = normalize(vec3(spongeDistance(p + e.xyy) - spongeDistance(p - e.xyy),\n"
+                                           "                                spongeDistance(p + e.yxy) - spongeDistance(p - e.yxy),\n"
+                                           "                                spongeDistance(p + e.yyx) - spongeDistance(p - e.yyx)));\n"
+                                           // lattice coordinates, the mip level from the lattice cells covered by a pixel
+                                           "   float cells = pow(3.0, float(depth - 1));\n"
+                                           "   vec3 lattice = (p + 1.0) * 0.5 * cells;\n"
+                                           "   float lod = log2(max(pixelAngle * t * 0.5 * cells * float(textureSize(ourTexture, 0).x), 1.0));\n"
+                                           "   vec3 weights = pow(abs(normal), vec3(4.0));\n"
+                                           "   weights /= weights.x + weights.y + weights.z;\n"
+                                           "   vec4 stone = textureLod(ourTexture, lattice.zy, lod) * weights.x +\n"
+                                           "                textureLod(ourTexture, lattice.xz, lod) * weights.y +\n"
+                                           "                textureLod(ourTexture, lattice.xy, lod) * weights.z;\n"
+                                           "   FragColor = stone * vec4(color, 1.0);\n"
+                                           // the depth of the hit, as the triangles would have written it
+                                           "   vec4 clip = matrix * vec4(center + p * halfWidth, 1.0);\n"
+                                           "   gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;\n"
+                                           "}\n\0";
+
+// exact traversal of the cubes: the ray walks the 3^(depth-1) lattice and looks every cell up in the 27-tree of
+// mengerOccupancy() from the root; a cell found empty at a coarse level is skipped whole, so the ray steps over the
+// large holes at once; the face and texture coordinates of the hit are those of the triangles of writeBox(), including
+// their split along the diagonal, and the texture gradients come from the neighbouring pixels' rays meeting the same
+// plane, as the rasterizer derives them from the triangle
+const char *voxelFragmentShaderSource = "#version 330 core\n"
+                                        "out vec4 FragColor;\n"
+                                        "uniform sampler2D ourTexture;\n"
+                                        "uniform usamplerBuffer occupancy;\n"
+                                        "uniform vec3 color;\n"
+                                        "uniform mat4 matrix;\n"
+                                        "uniform mat4 inverseMatrix;\n"
+                                        "uniform vec2 viewport;\n"
+                                        "uniform vec4 sponge;\n"
+                                        "uniform int depth;\n"
+                                        "const int MAX_STEPS = 2048;\n"
+                                        "int cells;\n"
+                                        // ray through a point of the window, in lattice coordinates
+                                        "vec3 latticeRay(vec2 fragCoord, out vec3 direction)\n"
+                                        "{\n"
+                                        "   vec2 ndc = fragCoord / viewport * 2.0 - 1.0;\n"
+                                        "   vec4 nearPoint = inverseMatrix * vec4(ndc, -1.0, 1.0);\n"
+                                        "   vec4 farPoint = inverseMatrix * vec4(ndc, 1.0, 1.0);\n"
+                                        "   float scale = float(cells) / sponge.w;\n"
+                                        "   direction = (farPoint.xyz / farPoint.w - nearPoint.xyz / nearPoint.w) * scale;\n"
+                                        "   return (nearPoint.xyz / nearPoint.w - sponge.xyz) * scale;\n"
+                                        "}\n"
+                                        // position on the face crossing the axis, along the edges from its first corner
+                                        "vec2 faceCoordinates(vec3 local, int axis)\n"
+                                        "{\n"
+                                        "   if (axis == 0)\n"
+                                        "      return vec2(1.0 - local.z, local.y);\n"
+                                        "   if (axis == 1)\n"
+                                        "      return local.xz;\n"
+                                        "   return local.xy;\n"
+                                        "}\n"
+                                        "vec2 faceUV(vec2 face, bool secondTriangle)\n"
+                                        "{\n"
+                                        "   return vec2(secondTriangle ? 0.5 + 0.5 * face.x : 0.5 * face.x, face.y);\n"
+                                        "}\n"
+                                        "void main()\n"
+                                        "{\n"
+                                        "   cells = 1;\n"
+                                        "   for (int level = 1; level < depth; level++)\n"
+                                        "      cells *= 3;\n"
+                                        "   vec3 direction;\n"
+                                        "   vec3 origin = latticeRay(gl_FragCoord.xy, direction);\n"
+                                        "   vec3 inverseDirection = 1.0 / direction;\n"
+                                        "   vec3 t0 = -origin * inverseDirection, t1 = (float(cells) - origin) * inverseDirection;\n"
+                                        "   vec3 tMin = min(t0, t1), tMax = max(t0, t1);\n"
+                                        "   float t = max(max(tMin.x, tMin.y), tMin.z);\n"
+                                        "   float tExit = min(min(tMax.x, tMax.y), tMax.z);\n"
+                                        // the axis of the last plane crossed is the face of the hit; a ray starting
+                                        // inside the sponge has none
+                                        "   int axis = tMin.x >= tMin.y && tMin.x >= tMin.z ? 0 : (tMin.y >= tMin.z ? 1 : 2);\n"
+                                        "   if (t < 0.0)\n"
+                                        "   {\n"
+                                        "      t = 0.0;\n"
+                                        "      axis = -1;\n"
+                                        "   }\n"
+                                        "   if (t > tExit)\n"
+                                        "      discard;\n"
+                                        "   bool hit = false;\n"
+                                        "   ivec3 cell = ivec3(0);\n"
+                                        "   for (int step = 0; step < MAX_STEPS; step++)\n"
+                                        "   {\n"
+                                        "      vec3 p = origin + direction * t;\n"
+                                        "      cell = ivec3(floor(p));\n"
+                                        // the crossed plane decides the cell along its axis, whatever the rounding of p
+                                        "      if (axis >= 0)\n"
+                                        "         cell[axis] = int(round(p[axis])) - (direction[axis] < 0.0 ? 1 : 0);\n"
+                                        "      cell = clamp(cell, ivec3(0), ivec3(cells - 1));\n"
+                                        "      int node = 0;\n"
+                                        "      int size = cells / 3;\n"
+                                        "      bool solid = true;\n"
+                                        "      for (int level = 0; level < depth - 1; level++)\n"
+                                        "      {\n"
+                                        "         ivec3 digit = (cell / size) % 3;\n"
+                                        "         int child = digit.x + 3 * digit.y + 9 * digit.z;\n"
+                                        "         if ((texelFetch(occupancy, node).r & (1u << uint(child))) == 0u)\n"
+                                        "         {\n"
+                                        "            solid = false;\n"
+                                        "            break;\n"
+                                        "         }\n"
+                                        "         if (level < depth - 2)\n"
+                                        "         {\n"
+                                        "            node = int(texelFetch(occupancy, node + 1 + child).r);\n"
+                                        "            size /= 3;\n"
+                                        "         }\n"
+                                        "      }\n"
+                                        "      if (solid)\n"
+                                        "      {\n"
+                                        "         hit = true;\n"
+                                        "         break;\n"
+                                        "      }\n"
+                                        // out of the empty cell of the level where the lookup stopped
+                                        "      vec3 empty = vec3(cell / size * size);\n"
+                                        "      vec3 exit = empty + vec3(greaterThan(direction, vec3(0.0))) * float(size);\n"
+                                        "      vec3 tCell = (exit - origin) * inverseDirection;\n"
+                                        "      t = min(min(tCell.x, tCell.y), tCell.z);\n"
+                                        "      axis = t == tCell.x ? 0 : (t == tCell.y ? 1 : 2);\n"
+                                        "      if (t >= tExit)\n"
+                                        "         break;\n"
+                                        "   }\n"
+                                        "   if (!hit || axis < 0)\n"
+                                        "      discard;\n"
+                                        "   vec3 p = origin + direction * t;\n"
+                                        "   vec2 face = clamp(faceCoordinates(p - vec3(cell), axis), 0.0, 1.0);\n"
+                                        "   bool secondTriangle = face.x + face.y > 1.0;\n"
+                                        "   vec2 uv = faceUV(face, secondTriangle);\n"
+                                        // differences across the 2 x 2 pixel quad, as the rasterizer takes them
+                                        "   vec2 quad = floor(gl_FragCoord.xy * 0.5) * 2.0 + 0.5;\n"
+                                        "   vec2 corner[3];\n"
+                                        "   for (int n = 0; n < 3; n++)\n"
+                                        "   {\n"
+                                        "      vec3 neighbourDirection;\n"
+                                        "      vec3 neighbour = latticeRay(quad + vec2(n == 1 ? 1.0 : 0.0, n == 2 ? 1.0 : 0.0), neighbourDirection);\n"
+                                        "      neighbour += neighbourDirection * ((p[axis] - neighbour[axis]) / neighbourDirection[axis]);\n"
+                                        "      corner[n] = faceUV(faceCoordinates(neighbour - vec3(cell), axis), secondTriangle);\n"
+                                        "   }\n"
+                                        "   vec2 dx = corner[1] - corner[0], dy = corner[2] - corner[0];\n"
+                                        "   FragColor = textureGrad(ourTexture, uv, dx, dy) * vec4(color, 1.0);\n"
+                                        "   vec4 clip = matrix * vec4(sponge.xyz + p * (sponge.w / float(cells)), 1.0);\n"
+                                        "   gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;\n"
+                                        "}\n\0";
+
+// the 2D carpet: a pixel is in a hole when at some level both base-3 digits of its position are 1. The levels above
+// the root cell of CarpetView come as the mask of the root and its neighbours; below it the position is a double-float
+// (a float and the float of its remainder), as a pixel there is finer than a float resolves. Tripling and dropping the
+// digit take additions only (twoSum), so no multiply-add contraction changes their rounding; precise keeps the compiler
+// from simplifying the error terms to 0, where GL_ARB_gpu_shader5 is missing the zoom is limited to float precision
+const char *carpetFragmentShaderSource = "#version 330 core\n"
+                                         // without it the compiler may simplify the rounding errors away
+                                         "#extension GL_ARB_gpu_shader5 : enable\n"
+                                         "#ifdef GL_ARB_gpu_shader5\n"
+                                         "#define EXACT precise\n"
+                                         "#else\n"
+                                         "#define EXACT\n"
+                                         "#endif\n"
+                                         "out vec4 FragColor;\n"
+                                         "uniform vec3 color;\n"
+                                         "uniform vec2 viewport;\n"
+                                         "uniform vec4 center;\n" // x and y of the view centre, then their remainders
+                                         "uniform float pixelSize;\n" // in units of the root cell
+                                         "uniform int rootMask;\n"
+                                         "uniform int levels;\n"
+                                         // s + e = a + b exactly
+                                         "void twoSum(vec2 a, vec2 b, out EXACT vec2 s, out EXACT vec2 e)\n"
+                                         "{\n"
+                                         "   s = a + b;\n"
+                                         "   EXACT vec2 bb = s - a;\n"
+                                         "   e = (a - (s - bb)) + (b - bb);\n"
+                                         "}\n"
+                                         // (hi, lo) += (bhi, blo), renormalized so that lo is below half an ulp of hi
+                                         "void add(inout EXACT vec2 hi, inout EXACT vec2 lo, vec2 bhi, vec2 blo)\n"
+                                         "{\n"
+                                         "   EXACT vec2 s, e;\n"
+                                         "   twoSum(hi, bhi, s, e);\n"
+                                         "   e += lo + blo;\n"
+                                         "   hi = s + e;\n"
+                                         "   lo = e - (hi - s);\n"
+                                         "}\n"
+                                         // integer part of hi + lo, removed from it
+                                         "vec2 takeFloor(inout vec2 hi, inout vec2 lo)\n"
+                                         "{\n"
+                                         "   vec2 whole = floor(hi);\n"
+                                         "   whole -= vec2(equal(whole, hi)) * vec2(lessThan(lo, vec2(0.0)));\n"
+                                         "   add(hi, lo, -whole, vec2(0.0));\n"
+                                         "   return whole;\n"
+                                         "}\n"
+                                         "void main()\n"
+                                         "{\n"
+                                         "   vec2 hi = center.xy, lo = center.zw;\n"
+                                         "   add(hi, lo, (gl_FragCoord.xy - viewport * 0.5) * pixelSize, vec2(0.0));\n"
+                                         "   ivec2 cell = ivec2(takeFloor(hi, lo));\n"
+                                         "   if (any(greaterThan(abs(cell), ivec2(1))) || ((rootMask >> (cell.x + 1 + 3 * (cell.y + 1))) & 1) == 0)\n"
+                                         "      discard;\n"
+                                         "   for (int level = 0; level < levels; level++)\n"
+                                         "   {\n"
+                                         "      add(hi, lo, hi * 2.0, lo * 2.0);\n"
+                                         "      if (takeFloor(hi, lo) == vec2(1.0))\n"
+                                         "         discard;\n"
+                                         "   }\n"
+                                         "   FragColor = vec4(color, 1.0);\n"
+                                         "}\n\0";
+
+// the sponge around the free camera: the root cell of FlyCamera and its neighbours, each a sponge of the ray marching
+// distance or empty, in units of the root cell with the camera at eye; the levels of holes go down to a pixel at the
+// distance of the nearest wall. The stone is blended between the tiles of the two levels around a ninth of that
+// distance, which stay in place when the root moves, so nothing jumps while diving
+const char *flyFragmentShaderSource = "#version 330 core\n"
+                                      "out vec4 FragColor;\n"
+                                      "uniform sampler2D ourTexture;\n"
+                                      "uniform vec3 color;\n"
+                                      "uniform vec2 viewport;\n"
+                                      "uniform vec3 eye;\n"
+                                      "uniform mat3 camera;\n" // right, up and forward
+                                      "uniform float tanHalfFov;\n"
+                                      "uniform float pixelAngle;\n"
+                                      "uniform int rootMask;\n"
+                                      "uniform int levels;\n"
+                                      "uniform float tileLevel;\n" // tiles 3^-tileLevel root cells large
+                                      "uniform float fogDistance;\n" // 0 - the whole sponge is in view
+                                      "const int MAX_STEPS = 256;\n"
+                                      "float cubeDistance(vec3 p)\n"
+                                      "{\n"
+                                      "   vec3 outside = abs(p) - vec3(1.0);\n"
+                                      "   float d = min(max(outside.x, max(outside.y, outside.z)), 0.0) + length(max(outside, 0.0));\n"
+                                      "   float scale = 1.0;\n"
+                                      "   for (int level = 1; level < levels; level++)\n"
+                                      "   {\n"
+                                      "      vec3 a = mod(p * scale, 2.0) - 1.0;\n"
+                                      "      scale *= 3.0;\n"
+                                      "      vec3 r = abs(1.0 - 3.0 * abs(a));\n"
+                                      "      float hole = min(max(r.x, r.y), min(max(r.y, r.z), max(r.z, r.x))) - 1.0;\n"
+                                      "      d = max(d, hole / scale);\n"
+                                      "   }\n"
+                                      "   return d;\n"
+                                      "}\n"
+                                      // a cell is evaluated only when its box is nearer than the walls found so far
+                                      "float spongeDistance(vec3 p)\n"
+                                      "{\n"
+                                      "   float d = 1e30;\n"
+                                      "   for (int n = 0; n < 27; n++)\n"
+                                      "   {\n"
+                                      "      if (((rootMask >> n) & 1) == 0)\n"
+                                      "         continue;\n"
+                                      "      vec3 low = vec3(n % 3, n / 3 % 3, n / 9) - 1.0;\n"
+                                      "      if (length(max(max(low - p, p - low - 1.0), 0.0)) < d)\n"
+                                      "         d = min(d, cubeDistance((p - low) * 2.0 - 1.0) * 0.5);\n"
+                                      "   }\n"
+                                      "   return d;\n"
+                                      "}\n"
+                                      "vec4 stoneAt(vec3 p, vec3 weights, float level, float footprint)\n"
+                                      "{\n"
+                                      "   float tiles = pow(3.0, level);\n"
+                                      "   float lod = log2(max(footprint * tiles * float(textureSize(ourTexture, 0).x), 1.0));\n"
+                                      "   p *= tiles;\n"
+                                      "   return textureLod(ourTexture, p.zy, lod) * weights.x + textureLod(ourTexture, p.xz, lod) * weights.y +\n"
+                                      "          textureLod(ourTexture, p.xy, lod) * weights.z;\n"
+                                      "}\n"
+                                      "void main()\n"
+                                      "{\n"
+                                      "   vec2 ndc = gl_FragCoord.xy / viewport * 2.0 - 1.0;\n"
+                                      "   vec3 direction = normalize(camera * vec3(ndc.x * tanHalfFov * viewport.x / viewport.y, ndc.y * tanHalfFov, 1.0));\n"
+                                      // the march stays within the root cell and its neighbours, [-1, 2]^3
+                                      "   vec3 inverseDirection = 1.0 / direction;\n"
+                                      "   vec3 t0 = (-1.0 - eye) * inverseDirection, t1 = (2.0 - eye) * inverseDirection;\n"
+                                      "   vec3 tMin = min(t0, t1), tMax = max(t0, t1);\n"
+                                      "   float t = max(max(max(tMin.x, tMin.y), tMin.z), 0.0);\n"
+                                      "   float tExit = min(min(tMax.x, tMax.y), tMax.z);\n"
+                                      "   if (t > tExit)\n"
+                                      "      discard;\n"
+                                      "   float epsilon = 0.0;\n"
+                                      "   bool hit = false;\n"
+                                      "   for (int step = 0; step < MAX_STEPS && t <= tExit; step++)\n"
+                                      "   {\n"
+                                      "      float d = spongeDistance(eye + direction * t);\n"
+                                      "      epsilon = max(pixelAngle * t * 0.5, 1e-7);\n"
+                                      "      if (d < epsilon)\n"
+                                      "      {\n"
+                                      "         hit = true;\n"
+                                      "         break;\n"
+                                      "      }\n"
+                                      "      t += d;\n"
+                                      "   }\n"
+                                      "   if (!hit)\n"
+                                      "      discard;\n"
+                                      "   vec3 p = eye + direction * t;\n"
+                                      "   vec2 e = vec2(epsilon, 0.0);\n"
+                                      "   vec3 normal = normalize(vec3(spongeDistance(p + e.xyy) - spongeDistance(p - e.xyy),\n"
+                                      "                                spongeDistance(p + e.yxy) - spongeDistance(p - e.yxy),\n"
+                                      "                                spongeDistance(p + e.yyx) - spongeDistance(p - e.yyx)));\n"
+                                      "   vec3 weights = pow(abs(normal), vec3(4.0));\n"
+                                      "   weights /= weights.x + weights.y + weights.z;\n"
+                                      "   float coarse = floor(tileLevel);\n"
+                                      "   vec4 stone = mix(stoneAt(p, weights, coarse, pixelAngle * t), stoneAt(p, weights, coarse + 1.0, pixelAngle * t),\n"
+                                      "                    tileLevel - coarse);\n"
+                                      // lit from the camera, faded out towards the end of the neighbourhood
+                                      "   float light = 0.4 + 0.6 * max(dot(normal, -direction), 0.0);\n"
+                                      "   float fade = fogDistance > 0.0 ? 1.0 - smoothstep(0.5 * fogDistance, fogDistance, t) : 1.0;\n"
+                                      "   FragColor = vec4(stone.rgb * color * light * fade, 1.0);\n"
+                                      "}\n\0";
+
+// RENDER_COMPUTE, GL 4.3: one invocation per cell of the 3^(depth-1) lattice appends the faces of its cube that do not
+// touch a solid neighbour, as mengerVisibleFaces() does, to the vertex buffer; the vertex count is the first field of
+// the glDrawArraysIndirect command. A work group adds up the vertices of its cells in shared memory and takes its
+// place in the buffer with one atomic, so the order of the faces changes from run to run
+const char *computeShaderSource = "#version 430 core\n"
+                                  "layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;\n"
+                                  "layout(std430, binding = 0) writeonly buffer Vertices { float vertices[]; };\n"
+                                  "layout(std430, binding = 1) buffer Command { uint vertexCount; uint instanceCount; uint firstVertex; uint baseInstance; };\n"
+                                  "uniform vec4 sponge;\n"
+                                  "uniform int size;\n" // lattice cells along an edge
+                                  "const ivec3 CORNERS[36] = ivec3[36](\n"
+                                  "   ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(0, 1, 0), ivec3(0, 1, 0), ivec3(1, 1, 0), ivec3(1, 0, 0),\n"
+                                  "   ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(0, 1, 1), ivec3(0, 1, 1), ivec3(1, 1, 1), ivec3(1, 0, 1),\n"
+                                  "   ivec3(0, 0, 1), ivec3(0, 0, 0), ivec3(0, 1, 1), ivec3(0, 1, 1), ivec3(0, 1, 0), ivec3(0, 0, 0),\n"
+                                  "   ivec3(1, 0, 1), ivec3(1, 0, 0), ivec3(1, 1, 1), ivec3(1, 1, 1), ivec3(1, 1, 0), ivec3(1, 0, 0),\n"
+                                  "   ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(0, 0, 1), ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 0, 0),\n"
+                                  "   ivec3(0, 1, 0), ivec3(1, 1, 0), ivec3(0, 1, 1), ivec3(0, 1, 1), ivec3(1, 1, 1), ivec3(1, 1, 0));\n"
+                                  "const vec2 UVS[6] = vec2[6](vec2(0, 0), vec2(0.5, 0), vec2(0, 1), vec2(0.5, 1), vec2(1, 1), vec2(1, 0));\n"
+                                  // outward directions of the faces: front, back, left, right, bottom, top
+                                  "const ivec3 DIRECTIONS[6] = ivec3[6](ivec3(0, 0, -1), ivec3(0, 0, 1), ivec3(-1, 0, 0), ivec3(1, 0, 0),\n"
+                                  "                                     ivec3(0, -1, 0), ivec3(0, 1, 0));\n"
+                                  "shared uint groupVertices;\n"
+                                  "shared uint groupFirst;\n"
+                                  // solid unless two base-3 digits of the cell are 1 at the same level
+                                  "bool solid(ivec3 cell)\n"
+                                  "{\n"
+                                  "   if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(size))))\n"
+                                  "      return false;\n"
+                                  "   for (; cell != ivec3(0); cell /= 3)\n"
+                                  "   {\n"
+                                  "      ivec3 ones = ivec3(equal(cell % 3, ivec3(1)));\n"
+                                  "      if (ones.x + ones.y + ones.z >= 2)\n"
+                                  "         return false;\n"
+                                  "   }\n"
+                                  "   return true;\n"
+                                  "}\n"
+                                  "void main()\n"
+                                  "{\n"
+                                  "   ivec3 cell = ivec3(gl_GlobalInvocationID);\n"
+                                  "   int faceMask = 0;\n"
+                                  "   if (solid(cell))\n"
+                                  "   {\n"
+                                  "      for (int face = 0; face < 6; face++)\n"
+                                  "      {\n"
+                                  "         if (!solid(cell + DIRECTIONS[face]))\n"
+                                  "            faceMask |= 1 << face;\n"
+                                  "      }\n"
+                                  "   }\n"
+                                  "   if (gl_LocalInvocationIndex == 0u)\n"
+                                  "      groupVertices = 0u;\n"
+                                  "   memoryBarrierShared();\n"
+                                  "   barrier();\n"
+                                  "   uint offset = faceMask != 0 ? atomicAdd(groupVertices, uint(bitCount(faceMask) * 6)) : 0u;\n"
+                                  "   memoryBarrierShared();\n"
+                                  "   barrier();\n"
+                                  "   if (gl_LocalInvocationIndex == 0u && groupVertices > 0u)\n"
+                                  "      groupFirst = atomicAdd(vertexCount, groupVertices);\n"
+                                  "   memoryBarrierShared();\n"
+                                  "   barrier();\n"
+                                  // every lattice corner becomes the same float in all the cubes sharing it
+                                  "   float width = sponge.w / float(size);\n"
+                                  "   uint cursor = (groupFirst + offset) * 5u;\n"
+                                  "   for (int face = 0; face < 6; face++)\n"
+                                  "   {\n"
+                                  "      if ((faceMask & (1 << face)) == 0)\n"
+                                  "         continue;\n"
+                                  "      for (int n = 0; n < 6; n++)\n"
+                                  "      {\n"
+                                  "         vec3 position = sponge.xyz + vec3(cell + CORNERS[face * 6 + n]) * width;\n"
+                                  "         vertices[cursor] = position.x;\n"
+                                  "         vertices[cursor + 1u] = position.y;\n"
+                                  "         vertices[cursor + 2u] = position.z;\n"
+                                  "         vertices[cursor + 3u] = UVS[n].x;\n"
+                                  "         vertices[cursor + 4u] = UVS[n].y;\n"
+                                  "         cursor += 5u;\n"
+                                  "      }\n"
+                                  "   }\n"
+                                  "}\n\0";
+
 static void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // CPU generator benchmarks, no window needed
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+        return runBenchmarks(argc, argv);
+
     // Setup window
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
@@ -126,33 +757,52 @@ int main()
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    // build and compile our shader program
-    // ------------------------------------
-    // vertex shader
-    int vertexShader = buildVertexShader();
-    // fragment shader
-    int fragmentShader = buildFragmentShader();
-    // link shaders
-    int shaderProgram = linkShaders(vertexShader, fragmentShader);
-    //cleaning up shader's objects
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    // build and compile our shader programs
+    // -------------------------------------
+    int shaderProgram = buildProgram(vertexShaderSource, fragmentShaderSource);
+    int instancedProgram = buildProgram(instancedVertexShaderSource, fragmentShaderSource);
+    int proceduralProgram = buildProgram(proceduralVertexShaderSource, fragmentShaderSource);
+    int compactProgram = buildProgram(compactVertexShaderSource, fragmentShaderSource);
+    int raymarchProgram = buildProgram(raymarchVertexShaderSource, raymarchFragmentShaderSource);
+    int voxelProgram = buildProgram(raymarchVertexShaderSource, voxelFragmentShaderSource);
+    int carpetProgram = buildProgram(raymarchVertexShaderSource, carpetFragmentShaderSource);
+    int flyProgram = buildProgram(raymarchVertexShaderSource, flyFragmentShaderSource);
+    // the stone texture stays on unit 0, the occupancy is bound to unit 1
+    glUseProgram(voxelProgram);
+    glUniform1i(glGetUniformLocation(voxelProgram, "occupancy"), 1);
+
+    // vertex shader invocations are counted only where the driver exposes pipeline statistics
+    has_pipeline_statistics = hasExtension("GL_ARB_pipeline_statistics_query");
+    // the function is only loaded by a 4.4 context
+    has_buffer_storage = hasExtension("GL_ARB_buffer_storage") && glBufferStorage != NULL;
+    // compute shaders, shader storage buffers and glDrawArraysIndirect are only loaded by a 4.3 context
+    int computeProgram = 0;
+    if (GLAD_GL_VERSION_4_3 && glDispatchCompute != NULL && glDrawArraysIndirect != NULL)
+        computeProgram = buildComputeProgram(computeShaderSource);
+    has_compute_shaders = computeProgram != 0;
+    max_compute_depth = has_compute_shaders ? computeDepthLimit() : 0;
+    unsigned int invocationsQuery = 0;
+    bool invocationsPending = false;
+    if (has_pipeline_statistics)
+        glGenQueries(1, &invocationsQuery);
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
     //calculateBox(-0.5f, -0.5f, 0.0f, 0.4f);
-    //sierpinskiCarpet(-1.0f, -1.0f, 0.0f, 2.0f, 0);
     //menger(-1,-1,0, 2, 0, max_depth);
-    menger(-0.8f,-0.8f, 0, 1.8f, max_depth);
 
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    // RENDER_PROCEDURAL has no buffers, but core profile still needs a VAO bound
+    unsigned int emptyVAO;
+    glGenVertexArrays(1, &emptyVAO);
 
-    fillVertexBuffer();
+    // RENDER_LOD keeps its cut between frames and uploads it again only when it changes
+    MengerLod lod(SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH);
+    SpongeBuffers lodBuffers;
+    createLodBuffers(lodBuffers);
+    OcclusionBlocks occlusion_blocks;
+    SoftwareOcclusion software_occlusion;
+    VoxelOccupancy voxel_occupancy;
+    ComputeSponge compute_sponge;
 
 
     // load and create a texture
@@ -178,20 +828,46 @@ int main()
     {
         std::cout << "Failed to load texture" << std::endl;
     }
+    // RGB is usually stored with 4 bytes per texel, the mipmaps add a third
+    size_t textureBytes = data ? (size_t)width * height * 4 * 4 / 3 : 0;
     stbi_image_free(data);
 
     // You can unbind the VAO afterwards so other VAO calls won't accidentally modify this VAO, but this rarely happens. Modifying other
     // VAOs requires a call to glBindVertexArray anyways so we generally don't unbind VAOs (nor VBOs) when it's not directly necessary.
     // glBindVertexArray(0);
 
-    // as we only have a single shader, we could also just activate our shader once beforehand if we want to
-    glUseProgram(shaderProgram);
-
 
     // pass projection matrix to shader (as projection matrix rarely changes there's no need to do this per frame)
     // -----------------------------------------------------------------------------------------------------------
     glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 
+    // OpenGLPAG --benchmark-raymarch [max depth]: needs the context, the programs and the texture, so unlike the CPU
+    // benchmarks it runs here
+    if (argc > 1 && strcmp(argv[1], "--benchmark-raymarch") == 0)
+    {
+        int result = benchmarkRaymarch(window, shaderProgram, raymarchProgram, voxelProgram, flyProgram, emptyVAO,
+                                       projection, argc > 2 ? atoi(argv[2]) : MAX_RAYMARCH_DEPTH);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return result;
+    }
+    // OpenGLPAG --benchmark-compute [max depth]: the visible faces generated by the compute shader against the CPU
+    // generator and its upload
+    if (argc > 1 && strcmp(argv[1], "--benchmark-compute") == 0)
+    {
+        int result = 1;
+        if (has_compute_shaders)
+            result = benchmarkCompute(computeProgram, argc > 2 ? atoi(argv[2]) : max_compute_depth);
+        else
+            fprintf(stderr, "compute shaders need an OpenGL 4.3 context\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return result;
+    }
+
+    // the first sponge is generated only past the benchmarks, which return without waiting for generation jobs
+    selectSponge(currentSpongeKey());
+
     // Setup Dear ImGui binding
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -231,18 +907,206 @@ int main()
             static int localRadiusY = (int)radiusY;
 
             ImGui::Begin("Glebokosc rekurencji / kolor", &isImGuiInit, ImGuiWindowFlags_NoTitleBar);           // Create a window called "sth" and append into it.
-            ImGui::SliderInt("Glebokosc", &localDepthLevel, 1, 5);            // Edit 1 int using a slider from 0 to 7
+            // the carpet and the fly-through are drawn down to the pixel size, there is no depth to choose
+            if (render_mode != RENDER_CARPET && render_mode != RENDER_FLY &&
+                ImGui::SliderInt("Glebokosc", &localDepthLevel, 1, maxDepthOf(render_mode)))            // Edit 1 int using a slider
+            {
+                // a depth that is already uploaded is shown at once, without confirming
+                SpongeKey key = currentSpongeKey();
+                key.depth = localDepthLevel;
+                if (generatesGeometry(render_mode) && findCachedSponge(key) != NULL)
+                {
+                    max_depth = localDepthLevel;
+                    selectSponge(currentSpongeKey());
+                }
+            }
             ImGui::ColorEdit3("Kolor", (float*)&clear_color); // Edit 3 floats representing a color
-
-            if (ImGui::Button("Zatwierdz poziom i kolor"))                            // Buttons return true when clicked (most widgets return true when edited/activated)
+            if (ImGui::Combo("Renderowanie", &render_mode, "Bufor wierzcholkow\0Instancje\0Proceduralnie (gl_InstanceID)\0Indeksowane (glDrawElements)\0LOD (blad w pikselach)\0Ray marching (SDF)\0Voksele (DDA, drzewo 27)\0Dywan 2D (shader, double-float)\0Lot w glab (SDF, bez limitu)\0Compute shader (GPU, glDrawArraysIndirect)\0"))
             {
-                vertices.clear();
+                localDepthLevel = std::min(localDepthLevel, maxDepthOf(render_mode));
+                max_depth = std::min(max_depth, maxDepthOf(render_mode));
+                selectSponge(currentSpongeKey());
+            }
+            // nothing to generate in procedural, LOD, ray marching and voxel modes, depth is just a uniform or a limit of the cut
+            if (!generatesGeometry(render_mode))
                 max_depth = localDepthLevel;
-                menger(-0.8f,-0.8f, 0, 1.8f, max_depth);
+            if (render_mode == RENDER_CARPET)
+            {
+                ImGui::Text("Przeciaganie myszy: przesuwanie, kolko: powiekszanie");
+                ImGui::Checkbox("Auto powiekszanie", &carpet_auto_zoom);
+                ImGui::SameLine();
+                if (ImGui::Button("Caly dywan"))
+                    carpet_view.reset();
+                ImGui::SliderFloat("Tempo (x/s)", &carpet_zoom_speed, 1.1f, 100.0f, "%.1f", 2.0f);
+            }
+            if (render_mode == RENDER_FLY)
+            {
+                ImGui::Text("WASD, Q/E: lot, przeciaganie myszy: rozgladanie sie");
+                ImGui::SliderFloat("Predkosc (odleglosci/s)", &fly_speed, 0.1f, 4.0f, "%.2f");
+                ImGui::SameLine();
+                if (ImGui::Button("Start"))
+                    fly_camera.reset();
+            }
+            if (render_mode == RENDER_COMPUTE && !has_compute_shaders)
+                ImGui::Text("Brak OpenGL 4.3: widoczne sciany generowane na CPU");
+            if (render_mode == RENDER_LOD)
+            {
+                ImGui::SliderFloat("Blad LOD (px)", &lod_pixel_error, 0.25f, 16.0f, "%.2f");
+                ImGui::SliderInt("Limit szescianow LOD", &lod_max_cubes, 1024, 2097152);
+                ImGui::SliderInt("Podzialy na klatke", &lod_splits_per_frame, 16, 65536);
+            }
+            if ((render_mode == RENDER_VERTICES || render_mode == RENDER_INDEXED) &&
+                ImGui::Combo("Geometria", &geometry_mode, "Pelne szesciany\0Widoczne sciany\0Scalone sciany\0"))
+                selectSponge(currentSpongeKey());
+            if (render_mode == RENDER_INDEXED && ImGui::Checkbox("Indeksy 32-bit", &use_32bit_indices))
+                selectSponge(currentSpongeKey());
+            if ((render_mode == RENDER_VERTICES || render_mode == RENDER_INDEXED) && geometry_mode != GEOMETRY_GREEDY &&
+                ImGui::Checkbox("Wierzcholki 8 B (siatka calkowita)", &compact_vertices))
+                selectSponge(currentSpongeKey());
+            ImGui::SliderInt("Watki (0 - wszystkie)", &generation_threads, 0, (int)std::thread::hardware_concurrency());
+            if (ImGui::SliderInt("Pamiec podreczna GPU (MB)", &cache_budget_mb, 16, 4096))
+                evictSponges();
+            ImGui::Checkbox("Przygotuj sasiednie poziomy w tle", &precompute_neighbours);
+            ImGui::SliderFloat("Wysylanie na GPU (ms/klatke)", &upload_budget_ms, 0.25f, 16.0f, "%.2f");
+            ImGui::Checkbox("Odrzucanie poza widokiem (frustum)", &frustum_culling);
+            ImGui::Combo("Zaslanianie", &occlusion_mode, "Wylaczone\0Zapytania GPU (bloki)\0Rasteryzacja CPU (SSE2)\0");
+            ImGui::Checkbox(has_buffer_storage ? "Generowanie do pamieci GPU (GL_ARB_buffer_storage)"
+                                               : "Generowanie do pamieci GPU (glMapBufferRange)", &zero_copy);
+
+            if (ImGui::Button("Zatwierdz poziom"))                            // Buttons return true when clicked (most widgets return true when edited/activated)
+            {
+                max_depth = localDepthLevel;
+                selectSponge(currentSpongeKey());
                 radiusX = (float)localRadiusX;
                 radiusY = (float)localRadiusY;
-                fillVertexBuffer();
             }
+            if (regeneration.result.valid())
+            {
+                char progressLabel[64];
+                float fraction = regeneration.progress->fraction();
+                snprintf(progressLabel, sizeof(progressLabel), "Generowanie poziomu %d: %.0f%%", regeneration.key.depth,
+                         100.0f * fraction);
+                ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f), progressLabel);
+            }
+            if (!sponge_cache.empty() && sponge_cache.front().staging)
+            {
+                const SpongeBuffers& uploading = sponge_cache.front().buffers;
+                size_t total = uploading.renderMode == RENDER_INSTANCED ? uploading.instanceCount : uploading.vertexCount;
+                ImGui::ProgressBar((float)uploading.readyCount / total, ImVec2(-1.0f, 0.0f), "Wysylanie na GPU");
+            }
+            if (shown_from_cache)
+                ImGui::Text("Generowanie: %.1f ms (z pamieci podrecznej: %.2f ms)", sponge_cache.front().buffers.generationMs,
+                            generation_ms);
+            else
+                ImGui::Text("Generowanie: %.1f ms", generation_ms);
+            if (render_mode == RENDER_LOD)
+            {
+                ImGui::Text("Szesciany: %u (pelna glebokosc: %.0f), wezly: %u, najglebszy poziom: %d",
+                            (unsigned int)lod.cubeCount(), (double)mengerCubeCount(max_depth), (unsigned int)lod.nodeCount(),
+                            lod.deepestLevel());
+                ImGui::Text("Aktualizacja LOD: %.2f ms%s", lod_update_ms, lod.converged() ? "" : ", doprecyzowywanie...");
+                ImGui::Text("Bufor: %.1f MB", lodBuffers.vertexBytes / (1024.0 * 1024.0));
+            }
+            else if (render_mode == RENDER_RAYMARCH)
+            {
+                ImGui::Text("Ray marching: %d poziomow dziur w SDF, do %d krokow na piksel", max_depth - 1, 256);
+                ImGui::Text("Bufor: 0 MB (pamiec niezalezna od glebokosci)");
+            }
+            else if (render_mode == RENDER_CARPET)
+            {
+                int framebufferWidth, framebufferHeight;
+                glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+                ImGui::Text("Powiekszenie: %.3g, poziom korzenia: %d, poziomy w shaderze: %d", carpet_view.magnification(),
+                            carpet_view.rootLevel(), carpetLevels(carpet_view, framebufferHeight));
+                ImGui::Text("Srodek: (%.17f, %.17f)", carpet_view.carpetX(), carpet_view.carpetY());
+                ImGui::Text("Bufor: 0 MB (bez geometrii)");
+            }
+            else if (render_mode == RENDER_FLY)
+            {
+                ImGui::Text("Korzen: poziom %d, sciana: %.3f korzenia, skala kamery: poziom %.2f", fly_camera.rootLevel(),
+                            fly_camera.distance(), fly_camera.scaleLevel());
+                ImGui::Text("Klatka: %.2f ms, bufor: 0 MB (pamiec niezalezna od glebokosci)", 1000.0f / ImGui::GetIO().Framerate);
+            }
+            else if (render_mode == RENDER_VOXEL)
+            {
+                ImGui::Text("Voksele: siatka %u^3, drzewo 27: %u wezlow", (unsigned int)mengerLatticeSize(max_depth),
+                            (unsigned int)(voxel_occupancy.bytes / (MENGER_OCCUPANCY_NODE * sizeof(unsigned int))));
+                ImGui::Text("Bufor: %.2f KB", voxel_occupancy.bytes / 1024.0);
+            }
+            else if (render_mode == RENDER_COMPUTE && has_compute_shaders)
+            {
+                ImGui::Text("Trojkaty: %u (licznik polecenia GPU), pelne szesciany: %u",
+                            (unsigned int)(compute_sponge.vertexCount / 3), (unsigned int)(mengerCubeCount(max_depth) * 12));
+                ImGui::Text("Generowanie na GPU: %.2f ms, bez pracy CPU i wysylania", compute_sponge.generationMs);
+                ImGui::Text("Bufor: %.1f MB", compute_sponge.vertexBytes / (1024.0 * 1024.0));
+            }
+            else if (render_mode == RENDER_PROCEDURAL || sponge_cache.empty())
+            {
+                ImGui::Text("Instancje: %u, trojkaty: %u", (unsigned int)mengerCubeCount(max_depth),
+                            (unsigned int)(mengerCubeCount(max_depth) * 12));
+                ImGui::Text("Bufor: 0 MB");
+            }
+            else
+            {
+                const SpongeBuffers& shown = sponge_cache.front().buffers;
+                if (render_mode == RENDER_INSTANCED)
+                {
+                    ImGui::Text("Instancje: %u, trojkaty: %u", (unsigned int)shown.instanceCount,
+                                (unsigned int)(shown.instanceCount * 12));
+                    ImGui::Text("Bufor: %.1f MB", shown.vertexBytes / (1024.0 * 1024.0));
+                }
+                else if (render_mode == RENDER_INDEXED)
+                {
+                    // the same quads without indices take 6 vertices each
+                    size_t quads = shown.vertexCount / MENGER_QUAD_VERTICES;
+                    ImGui::Text("Trojkaty: %u, wierzcholki: %u", (unsigned int)(quads * 2), (unsigned int)shown.vertexCount);
+                    ImGui::Text("Bufor: %.1f MB + indeksy %.2f MB (bez indeksow: %.1f MB)",
+                                shown.vertexBytes / (1024.0 * 1024.0), shown.indexBytes / (1024.0 * 1024.0),
+                                quads * 6 * (shown.vertexBytes / shown.vertexCount) / (1024.0 * 1024.0));
+                }
+                else
+                {
+                    ImGui::Text("Trojkaty: %u (pelne szesciany: %u)", (unsigned int)(shown.vertexCount / 3),
+                                (unsigned int)(mengerCubeCount(sponge_cache.front().key.depth) * 12));
+                    ImGui::Text("Bufor: %.1f MB", shown.vertexBytes / (1024.0 * 1024.0));
+                }
+                if (shown.mapped.buffer != 0)
+                    ImGui::Text("Wierzcholki zapisane wprost do bufora GPU, bez kopii");
+                // the whole vertex buffer is fetched by every frame, so its size is also the per-frame vertex bandwidth
+                if (shown.compact)
+                    ImGui::Text("Wierzcholki %d B zamiast %d B: %.1f MB mniej na klatke", (int)sizeof(CompactVertex),
+                                (int)(MENGER_VERTEX_FLOATS * sizeof(float)),
+                                shown.vertexCount * (MENGER_VERTEX_FLOATS * sizeof(float) - sizeof(CompactVertex)) / (1024.0 * 1024.0));
+            }
+            ImGui::Text("Pamiec podreczna: %u siatek, %.1f MB%s", (unsigned int)sponge_cache.size(),
+                        cachedSpongeBytes() / (1024.0 * 1024.0), precompute.result.valid() ? ", przygotowywanie..." : "");
+            if (!frustum_culling)
+                ImGui::Text("Frustum: wylaczone, trojkaty: %u", (unsigned int)drawn_triangles);
+            else if (render_mode == RENDER_LOD)
+                ImGui::Text("Frustum: odrzucone liscie LOD: %u, trojkaty: %u", (unsigned int)lod.culledCount(),
+                            (unsigned int)drawn_triangles);
+            else if (cull_stats.testedNodes == 0)
+                ImGui::Text("Frustum: brak podzialu na komorki w tym trybie, trojkaty: %u", (unsigned int)drawn_triangles);
+            else
+                ImGui::Text("Frustum: komorki widoczne %u, odrzucone %u, testy %u, trojkaty: %u",
+                            (unsigned int)cull_stats.visibleCells, (unsigned int)cull_stats.culledCells,
+                            (unsigned int)cull_stats.testedNodes, (unsigned int)drawn_triangles);
+            if (occlusion_mode == OCCLUSION_QUERIES && drawn_cell_levels >= 0)
+                ImGui::Text("Zaslanianie: bloki testowane %u, pominiete (zasloniete) %u", (unsigned int)occlusion_tested,
+                            (unsigned int)occlusion_hidden);
+            else if (occlusion_mode == OCCLUSION_SOFTWARE && drawn_cell_levels >= 0)
+            {
+                ImGui::Text("Zaslanianie CPU: komorki %u, zasloniete %u", (unsigned int)occlusion_tested,
+                            (unsigned int)occlusion_hidden);
+                ImGui::Text("Rasteryzacja: %.2f ms (%u trojkatow), testy: %.2f ms", occlusion_raster_ms,
+                            (unsigned int)software_occlusion.raster.rasterizedTriangles(), occlusion_test_ms);
+            }
+            else if (occlusion_mode != OCCLUSION_NONE)
+                ImGui::Text("Zaslanianie: brak podzialu na bloki w tym trybie");
+            if (has_pipeline_statistics)
+                ImGui::Text("Wywolania vertex shadera: %llu", (unsigned long long)vertex_invocations);
+            else
+                ImGui::Text("Wywolania vertex shadera: brak GL_ARB_pipeline_statistics_query");
             ImGui::NewLine();
 
             ImGui::Checkbox("Auto obrót", &autoRotate);
@@ -276,12 +1140,19 @@ int main()
             }
 
             ImGui::End();
+            showMemoryPanel(textureBytes, lodBuffers, voxel_occupancy, compute_sponge);
         }
 
 
         // Rendering
         ImGui::Render();
         glfwMakeContextCurrent(window);
+        // sampled before a finished job is taken over, so that its last frames are counted
+        resident_bytes = processResidentBytes();
+        if (regeneration.result.valid() || (!sponge_cache.empty() && sponge_cache.front().staging))
+            regeneration_peak_bytes = std::max(regeneration_peak_bytes, resident_bytes);
+        updateGenerationJobs(render_mode);
+        streamUploads();
         glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // also clear the depth buffer now!
 
@@ -299,17 +1170,213 @@ int main()
         //model = glm::rotate(model, glm::radians((float)radiusX), glm::vec3(1.0f, 0.0f, 0.0f));
         //model = glm::rotate(model, glm::radians((float)radiusY), glm::vec3(0.0f, 1.0f, 0.0f));
 
+        // the carpet and the fly-through camera follow the input at the rate of the frames
+        static double lastFrameTime = glfwGetTime();
+        double frameTime = glfwGetTime();
+        if (render_mode == RENDER_CARPET)
+            updateCarpetView(carpet_view, frameTime - lastFrameTime);
+        else if (render_mode == RENDER_FLY)
+            updateFlyCamera(window, fly_camera, frameTime - lastFrameTime);
+        lastFrameTime = frameTime;
+
+        if (render_mode == RENDER_LOD)
+        {
+            // camera in sponge coordinates and the pixels covered by a unit length at distance 1
+            glm::vec4 eye = glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            float pixelsPerUnit = framebufferHeight / (2.0f * std::tan(glm::radians(45.0f) / 2.0f));
+
+            LodSettings settings;
+            settings.maxDepth = max_depth;
+            settings.pixelError = lod_pixel_error;
+            settings.maxCubes = (size_t)lod_max_cubes;
+            settings.splitsPerUpdate = (size_t)lod_splits_per_frame;
+            double start = glfwGetTime();
+            MengerFrustum frustum = frustumOf(projection * view * model);
+            if (lod.update(eye.x, eye.y, eye.z, pixelsPerUnit, frustum_culling ? &frustum : NULL, settings))
+            {
+                uploadLodCubes(lodBuffers, lod);
+                lod_update_ms = (glfwGetTime() - start) * 1000.0;
+            }
+        }
+
+        // a new depth is generated on the GPU before the frame draws it
+        if (render_mode == RENDER_COMPUTE && has_compute_shaders)
+            prepareComputeSponge(compute_sponge, computeProgram, max_depth);
+
+        int program = shaderProgram;
+        if (render_mode == RENDER_INSTANCED || render_mode == RENDER_LOD)
+            program = instancedProgram;
+        else if (render_mode == RENDER_PROCEDURAL)
+            program = proceduralProgram;
+        else if (render_mode == RENDER_RAYMARCH)
+            program = raymarchProgram;
+        else if (render_mode == RENDER_VOXEL)
+            program = voxelProgram;
+        else if (render_mode == RENDER_CARPET)
+            program = carpetProgram;
+        else if (render_mode == RENDER_FLY)
+            program = flyProgram;
+        else if (generatesGeometry(render_mode) && !sponge_cache.empty() && drawnSponge().buffers.compact)
+            program = compactProgram;
+        glUseProgram(program);
+
         // pass transformation matrices to the shader
-        GLint modelLoc = glGetUniformLocation(shaderProgram, "model");
+        GLint modelLoc = glGetUniformLocation(program, "model");
         glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        GLint viewLoc = glGetUniformLocation(shaderProgram, "view");
+        GLint viewLoc = glGetUniformLocation(program, "view");
         glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        GLint projectionLoc = glGetUniformLocation(shaderProgram, "projection");
+        GLint projectionLoc = glGetUniformLocation(program, "projection");
         glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
-        // render the triangle
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 3*vertices.size()/4);
+        // the colour is applied every frame, editing it needs no regeneration
+        glUniform3f(glGetUniformLocation(program, "color"), clear_color.x, clear_color.y, clear_color.z);
+
+        if (render_mode == RENDER_PROCEDURAL)
+        {
+            glUniform4f(glGetUniformLocation(program, "sponge"), SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH);
+            glUniform1i(glGetUniformLocation(program, "depth"), max_depth);
+        }
+        else if (render_mode == RENDER_RAYMARCH || render_mode == RENDER_VOXEL)
+        {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            setRaymarchUniforms(program, projection * view * model, framebufferWidth, framebufferHeight, max_depth);
+            if (render_mode == RENDER_VOXEL)
+            {
+                prepareVoxelOccupancy(voxel_occupancy, max_depth);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_BUFFER, voxel_occupancy.texture);
+                glActiveTexture(GL_TEXTURE0);
+            }
+        }
+        else if (render_mode == RENDER_CARPET)
+        {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            setCarpetUniforms(program, carpet_view, framebufferWidth, framebufferHeight);
+        }
+        else if (render_mode == RENDER_FLY)
+        {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            setFlyUniforms(program, fly_camera, framebufferWidth, framebufferHeight);
+        }
+        else if (program == compactProgram)
+        {
+            // the drawn sponge may still be the previous depth while the new one is generated
+            glUniform4f(glGetUniformLocation(program, "lattice"), SPONGE_X, SPONGE_Y, SPONGE_Z,
+                        SPONGE_WIDTH / (float)mengerLatticeSize(drawnSponge().key.depth));
+        }
+
+        // render the sponge, the invocation count of a previous frame is picked up once the GPU has it ready
+        if (invocationsPending)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(invocationsQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                glGetQueryObjectui64v(invocationsQuery, GL_QUERY_RESULT, &vertex_invocations);
+                invocationsPending = false;
+            }
+        }
+        bool queryStarted = has_pipeline_statistics && !invocationsPending;
+        if (queryStarted)
+            glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS, invocationsQuery);
+        // cells of the drawn sponge inside the view, found from the boxes of whole sub-trees
+        static std::vector<MengerCellRange> visibleCells;
+        visibleCells.clear();
+        cull_stats = MengerCullStats();
+        int cellLevels = 0;
+        if (render_mode == RENDER_PROCEDURAL)
+            cellLevels = cullCellLevels(max_depth);
+        else if (generatesGeometry(render_mode) && !sponge_cache.empty())
+            cellLevels = drawnSponge().buffers.cellCount > 0 ? drawnSponge().buffers.cullCellLevels : -1;
+        else
+            cellLevels = -1;
+        if (frustum_culling && cellLevels >= 0)
+            mengerCull(visibleCells, cull_stats, frustumOf(projection * view * model), SPONGE_X, SPONGE_Y, SPONGE_Z,
+                       SPONGE_WIDTH, cellLevels);
+        const std::vector<MengerCellRange>* ranges = frustum_culling && cellLevels >= 0 ? &visibleCells : NULL;
+        // occlusion culling needs the cells too, LOD cuts and greedy meshes are drawn whole
+        if (occlusion_mode == OCCLUSION_SOFTWARE && cellLevels >= 0)
+        {
+            if (ranges == NULL)
+            {
+                MengerCellRange all = {0, mengerCubeCount(cellLevels + 1)};
+                visibleCells.assign(1, all);
+            }
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            cullOccludedCells(software_occlusion, visibleCells, max_depth, cellLevels, projection * view * model,
+                              framebufferWidth, framebufferHeight);
+            ranges = &visibleCells;
+        }
+        const bool occlusion = occlusion_mode == OCCLUSION_QUERIES && cellLevels >= 0;
+        drawn_cell_levels = cellLevels;
+
+        drawn_triangles = 0;
+        if (render_mode == RENDER_LOD)
+        {
+            drawn_triangles = drawSponge(lodBuffers, NULL);
+        }
+        else if (render_mode == RENDER_RAYMARCH || render_mode == RENDER_VOXEL || render_mode == RENDER_CARPET ||
+                 render_mode == RENDER_FLY)
+        {
+            glBindVertexArray(emptyVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            drawn_triangles = 1;
+        }
+        else if (render_mode == RENDER_COMPUTE && has_compute_shaders)
+        {
+            drawComputeSponge(compute_sponge);
+            drawn_triangles = compute_sponge.vertexCount / 3;
+        }
+        else if (render_mode == RENDER_PROCEDURAL || !sponge_cache.empty())
+        {
+            const SpongeBuffers* buffers = NULL;
+            if (render_mode == RENDER_PROCEDURAL)
+                glBindVertexArray(emptyVAO);
+            else
+                buffers = &drawnSponge().buffers;
+            GLint firstInstanceLoc = glGetUniformLocation(program, "firstInstance");
+            if (occlusion)
+            {
+                if (ranges == NULL)
+                {
+                    MengerCellRange all = {0, mengerCubeCount(cellLevels + 1)};
+                    visibleCells.assign(1, all);
+                }
+                drawn_triangles = drawOccluded(occlusion_blocks, buffers, firstInstanceLoc, max_depth, cellLevels,
+                                               visibleCells);
+            }
+            else
+            {
+                drawn_triangles = drawCells(buffers, firstInstanceLoc, max_depth, ranges);
+            }
+        }
+        if (queryStarted)
+        {
+            glEndQuery(GL_VERTEX_SHADER_INVOCATIONS);
+            invocationsPending = true;
+        }
+
+        // the boxes of the blocks drawn in this frame are tested against its depth, for the next frame
+        if (occlusion)
+        {
+            glUseProgram(instancedProgram);
+            glUniformMatrix4fv(glGetUniformLocation(instancedProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+            glUniformMatrix4fv(glGetUniformLocation(instancedProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(glGetUniformLocation(instancedProgram, "projection"), 1, GL_FALSE,
+                               glm::value_ptr(projection));
+            queryOcclusionBlocks(occlusion_blocks);
+        }
+        else
+        {
+            // results left from an earlier view are not used when culling is turned on again
+            std::fill(occlusion_blocks.queried.begin(), occlusion_blocks.queried.end(), 0);
+        }
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         glfwSwapBuffers(window);
@@ -321,8 +1388,23 @@ int main()
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    deleteSpongeCache();
+    glDeleteVertexArrays(1, &emptyVAO);
+    deleteSpongeBuffers(lodBuffers);
+    deleteOcclusionBlocks(occlusion_blocks);
+    deleteVoxelOccupancy(voxel_occupancy);
+    deleteComputeSponge(compute_sponge);
+    if (has_pipeline_statistics)
+        glDeleteQueries(1, &invocationsQuery);
+    glDeleteProgram(shaderProgram);
+    glDeleteProgram(instancedProgram);
+    glDeleteProgram(proceduralProgram);
+    glDeleteProgram(compactProgram);
+    glDeleteProgram(raymarchProgram);
+    glDeleteProgram(voxelProgram);
+    glDeleteProgram(carpetProgram);
+    glDeleteProgram(flyProgram);
+    glDeleteProgram(computeProgram);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -356,10 +1438,10 @@ GLFWwindow* initializeWindow()
 }
 
 // building vertex shader
-int buildVertexShader()
+int buildVertexShader(const char* source)
 {
     int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glShaderSource(vertexShader, 1, &source, NULL);
     glCompileShader(vertexShader);
 
     // check for shader compile errors
@@ -377,10 +1459,10 @@ int buildVertexShader()
 }
 
 // building fragment shader
-int buildFragmentShader()
+int buildFragmentShader(const char* source)
 {
     int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glShaderSource(fragmentShader, 1, &source, NULL);
     glCompileShader(fragmentShader);
 
     // check for shader compile errors
@@ -418,23 +1500,439 @@ int linkShaders(int vertexShader, int fragmentShader)
     return shaderProgram;
 }
 
-// fill Vertex Buffer
-void fillVertexBuffer()
+// compile, link and clean up shader's objects
+int buildProgram(const char* vertexSource, const char* fragmentSource)
+{
+    int vertexShader = buildVertexShader(vertexSource);
+    int fragmentShader = buildFragmentShader(fragmentSource);
+    int shaderProgram = linkShaders(vertexShader, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    return shaderProgram;
+}
+
+// compute shader programs have a single stage
+int buildComputeProgram(const char* source)
+{
+    int computeShader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShader, 1, &source, NULL);
+    glCompileShader(computeShader);
+
+    int success;
+    char infoLog[512];
+    glGetShaderiv(computeShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(computeShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glDeleteShader(computeShader);
+        return 0;
+    }
+
+    int program = glCreateProgram();
+    glAttachShader(program, computeShader);
+    glLinkProgram(program);
+    glDeleteShader(computeShader);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+// dragging with the left button moves the carpet with the cursor, the wheel zooms about the cursor; not while the
+// mouse is over the UI
+void updateCarpetView(CarpetView& view, double seconds)
 {
-    // fill with vertex data
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    ImGuiIO& io = ImGui::GetIO();
+    double height = std::max(io.DisplaySize.y, 1.0f);
+    if (!io.WantCaptureMouse)
+    {
+        // window y grows down, the carpet's up
+        if (io.MouseDown[0])
+            view.pan(-io.MouseDelta.x / height, io.MouseDelta.y / height);
+        if (io.MouseWheel != 0.0f)
+            view.zoom(std::pow(1.25, (double)io.MouseWheel), (io.MousePos.x - io.DisplaySize.x * 0.5) / height,
+                      (io.DisplaySize.y * 0.5 - io.MousePos.y) / height);
+    }
+    if (carpet_auto_zoom)
+        view.zoom(std::pow((double)carpet_zoom_speed, seconds), 0.0, 0.0);
+}
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+// W/S forward and back, A/D sideways, Q/E down and up; dragging with the left button turns the camera. Not while the
+// UI has the mouse or the keyboard
+void updateFlyCamera(GLFWwindow* window, FlyCamera& camera, double seconds)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    if (!io.WantCaptureMouse && io.MouseDown[0])
+    {
+        double radiansPerPixel = glm::radians(45.0) / std::max(io.DisplaySize.y, 1.0f);
+        camera.turn(-io.MouseDelta.x * radiansPerPixel, -io.MouseDelta.y * radiansPerPixel);
+    }
+    if (io.WantCaptureKeyboard)
+        return;
+    double forward = 0.0, right = 0.0, up = 0.0;
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        forward += 1.0;
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        forward -= 1.0;
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        right += 1.0;
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        right -= 1.0;
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+        up += 1.0;
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+        up -= 1.0;
+    double step = fly_speed * seconds;
+    if (forward != 0.0 || right != 0.0 || up != 0.0)
+        camera.move(forward * step, right * step, up * step);
+}
 
-    // color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+// planes of the clip volume of a matrix (Gribb & Hartmann): the last row plus or minus each of the first three,
+// in the coordinates the matrix is applied to
+MengerFrustum frustumOf(const glm::mat4& matrix)
+{
+    MengerFrustum frustum;
+    for (int plane = 0; plane < 6; plane++)
+    {
+        int row = plane / 2;
+        float sign = plane % 2 == 0 ? 1.0f : -1.0f;
+        for (int column = 0; column < 4; column++)
+            frustum.planes[plane][column] = matrix[column][3] + sign * matrix[column][row];
+    }
+    return frustum;
+}
 
-    // texture coord attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+// unit cube and an empty instance buffer for the cubes of the LOD cut
+void createLodBuffers(SpongeBuffers& buffers)
+{
+    glGenVertexArrays(1, &buffers.VAO);
+    glGenBuffers(1, &buffers.VBO);
+    glGenBuffers(1, &buffers.instanceVBO);
+    buffers.renderMode = RENDER_INSTANCED;
+    fillInstanceBuffer(buffers, SpongeGeometry());
+}
+
+// replace the instances with the current cut; glBufferData gives new storage, so frames still drawing the old cut
+// do not stall the upload
+void uploadLodCubes(SpongeBuffers& buffers, const MengerLod& lod)
+{
+    const std::vector<float>& cubes = lod.cubes();
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, cubes.size() * sizeof(float), cubes.data(), GL_STREAM_DRAW);
+    buffers.instanceCount = buffers.readyCount = lod.cubeCount();
+    buffers.vertexBytes = (MENGER_CUBE_FLOATS + cubes.size()) * sizeof(float);
+}
+
+// draw the cells of ranges of the procedural sponge, all of them when ranges is NULL; returns the number of drawn
+// triangles
+size_t drawProcedural(GLint firstInstanceLoc, int depth, const std::vector<MengerCellRange>* ranges)
+{
+    const int cellLevels = cullCellLevels(depth);
+    const size_t cubesPerCell = mengerCubeCount(depth) / mengerCubeCount(cellLevels + 1);
+    const MengerCellRange all = {0, mengerCubeCount(cellLevels + 1)};
+    size_t triangles = 0;
+    for (size_t n = 0, count = ranges != NULL ? ranges->size() : 1; n < count; n++)
+    {
+        const MengerCellRange& range = ranges != NULL ? (*ranges)[n] : all;
+        glUniform1i(firstInstanceLoc, (GLint)(range.first * cubesPerCell));
+        glDrawArraysInstanced(GL_TRIANGLES, 0, MENGER_CUBE_VERTICES, (GLsizei)(range.count * cubesPerCell));
+        triangles += range.count * cubesPerCell * 12;
+    }
+    return triangles;
+}
+
+// cells of an uploaded sponge, or of the procedural one when buffers is NULL
+size_t drawCells(const SpongeBuffers* buffers, GLint firstInstanceLoc, int depth,
+                 const std::vector<MengerCellRange>* ranges)
+{
+    return buffers != NULL ? drawSponge(*buffers, ranges) : drawProcedural(firstInstanceLoc, depth, ranges);
+}
+
+// query objects and bounding boxes of the blocks of the given levels, kept while the levels stay the same
+void prepareOcclusionBlocks(OcclusionBlocks& blocks, int levels)
+{
+    if (blocks.levels == levels)
+        return;
+    deleteOcclusionBlocks(blocks);
+    blocks.levels = levels;
+
+    // the boxes of the blocks are the cubes of a sponge one level deeper than the blocks; they are grown a little, so
+    // that a box does not lose the depth test against the faces of its own block
+    SpongeGeometry geometry;
+    mengerInstances(geometry.instances, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, levels + 1, 1, NULL);
+    const float margin = SPONGE_WIDTH * 0.001f;
+    for (size_t n = 0; n < geometry.instances.size; n += MENGER_INSTANCE_FLOATS)
+    {
+        float* box = geometry.instances.data + n;
+        box[0] -= margin;
+        box[1] -= margin;
+        box[2] -= margin;
+        box[3] += 2.0f * margin;
+    }
+    glGenVertexArrays(1, &blocks.boxes.VAO);
+    glGenBuffers(1, &blocks.boxes.VBO);
+    glGenBuffers(1, &blocks.boxes.instanceVBO);
+    blocks.boxes.renderMode = RENDER_INSTANCED;
+    fillInstanceBuffer(blocks.boxes, geometry);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, geometry.instances.size * sizeof(float), geometry.instances.data);
+
+    const size_t count = blocks.boxes.instanceCount;
+    blocks.queries.resize(count);
+    glGenQueries((GLsizei)count, blocks.queries.data());
+    blocks.queried.assign(count, 0);
+    blocks.cells.resize(count);
+}
+
+void deleteOcclusionBlocks(OcclusionBlocks& blocks)
+{
+    if (blocks.levels < 0)
+        return;
+    glDeleteQueries((GLsizei)blocks.queries.size(), blocks.queries.data());
+    deleteSpongeBuffers(blocks.boxes);
+    blocks = OcclusionBlocks();
+}
+
+// draw the visible cells block by block, every block that has a query from the last frame only when its box passed
+// the depth test then; GL_QUERY_NO_WAIT draws the block when the result is not there yet, so the CPU never waits
+size_t drawOccluded(OcclusionBlocks& blocks, const SpongeBuffers* buffers, GLint firstInstanceLoc, int depth,
+                    int cellLevels, const std::vector<MengerCellRange>& ranges)
+{
+    prepareOcclusionBlocks(blocks, std::min(cellLevels, OCCLUSION_BLOCK_LEVELS));
+    const size_t cellsPerBlock = mengerCubeCount(cellLevels - blocks.levels + 1);
+
+    // the ranges are split at block boundaries
+    for (std::vector<MengerCellRange>& cells : blocks.cells)
+        cells.clear();
+    for (const MengerCellRange& range : ranges)
+    {
+        for (size_t cell = range.first, end = range.first + range.count; cell < end;)
+        {
+            size_t block = cell / cellsPerBlock;
+            MengerCellRange part = {cell, std::min(end, (block + 1) * cellsPerBlock) - cell};
+            blocks.cells[block].push_back(part);
+            cell += part.count;
+        }
+    }
+
+    size_t triangles = 0;
+    for (size_t block = 0; block < blocks.cells.size(); block++)
+    {
+        if (blocks.cells[block].empty())
+            continue;
+        if (blocks.queried[block])
+            glBeginConditionalRender(blocks.queries[block], GL_QUERY_NO_WAIT);
+        triangles += drawCells(buffers, firstInstanceLoc, depth, &blocks.cells[block]);
+        if (blocks.queried[block])
+            glEndConditionalRender();
+    }
+    return triangles;
+}
+
+// test the boxes of the blocks drawn in this frame against its depth, with colour and depth writes off; the
+// instanced program is bound with the matrices of the frame
+void queryOcclusionBlocks(OcclusionBlocks& blocks)
+{
+    // the results of the previous queries are counted first, when they are ready
+    occlusion_tested = occlusion_hidden = 0;
+    for (size_t block = 0; block < blocks.queried.size(); block++)
+    {
+        if (!blocks.queried[block])
+            continue;
+        occlusion_tested++;
+        GLint available = 0;
+        glGetQueryObjectiv(blocks.queries[block], GL_QUERY_RESULT_AVAILABLE, &available);
+        GLuint passed = 1;
+        if (available)
+            glGetQueryObjectuiv(blocks.queries[block], GL_QUERY_RESULT, &passed);
+        if (!passed)
+            occlusion_hidden++;
+    }
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    glBindVertexArray(blocks.boxes.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, blocks.boxes.instanceVBO);
+    for (size_t block = 0; block < blocks.cells.size(); block++)
+    {
+        // blocks outside the frustum get no query and are drawn unconditionally once they come back into view
+        blocks.queried[block] = !blocks.cells[block].empty();
+        if (!blocks.queried[block])
+            continue;
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, MENGER_INSTANCE_FLOATS * sizeof(float),
+                              (void*)(block * MENGER_INSTANCE_FLOATS * sizeof(float)));
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, blocks.queries[block]);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, MENGER_CUBE_VERTICES, 1);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, MENGER_INSTANCE_FLOATS * sizeof(float), (void*)0);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// replace ranges with their cells not hidden behind the largest faces of the sponge, rasterized on the CPU
+void cullOccludedCells(SoftwareOcclusion& occlusion, std::vector<MengerCellRange>& ranges, int depth, int cellLevels,
+                       const glm::mat4& matrix, int framebufferWidth, int framebufferHeight)
+{
+    const int occluderDepth = std::min(depth, MAX_OCCLUDER_DEPTH);
+    if (occlusion.occluderDepth != occluderDepth)
+    {
+        mengerOccluders(occlusion.occluders, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, occluderDepth, MAX_OCCLUDERS,
+                        (unsigned int)generation_threads);
+        occlusion.occluderDepth = occluderDepth;
+    }
+    // a cell is the cube of a sponge one level deeper than the cells
+    if (occlusion.cellLevels != cellLevels)
+    {
+        mengerInstances(occlusion.cellBoxes, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, cellLevels + 1,
+                        (unsigned int)generation_threads);
+        occlusion.cellLevels = cellLevels;
+    }
+    int height = framebufferWidth > 0 ? SOFTWARE_OCCLUSION_WIDTH * framebufferHeight / framebufferWidth : 0;
+    if (occlusion.raster.width() != SOFTWARE_OCCLUSION_WIDTH || occlusion.raster.height() < height ||
+        occlusion.raster.height() >= height + OcclusionRaster::TILE_HEIGHT)
+        occlusion.raster.resize(SOFTWARE_OCCLUSION_WIDTH, height);
+
+    double start = glfwGetTime();
+    occlusion.raster.clear();
+    occlusion.raster.rasterizeQuads(glm::value_ptr(matrix), occlusion.occluders.data(), occlusion.occluders.size() / 12);
+    occlusion.raster.finish();
+    occlusion_raster_ms = (glfwGetTime() - start) * 1000.0;
+
+    // the cells of the ranges are tested and the ones left visible merged into ranges again
+    start = glfwGetTime();
+    const size_t cellCount = occlusion.cellBoxes.size / MENGER_INSTANCE_FLOATS;
+    occlusion.visible.assign(cellCount, 0);
+    occlusion_tested = 0;
+    for (const MengerCellRange& range : ranges)
+    {
+        std::fill(occlusion.visible.begin() + range.first, occlusion.visible.begin() + range.first + range.count, 1);
+        occlusion_tested += range.count;
+    }
+    occlusion.raster.cullBoxes(glm::value_ptr(matrix), occlusion.cellBoxes.data, cellCount, occlusion.visible,
+                               (unsigned int)generation_threads);
+    ranges.clear();
+    size_t shown = 0;
+    for (size_t cell = 0; cell < cellCount; cell++)
+    {
+        if (!occlusion.visible[cell])
+            continue;
+        shown++;
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == cell)
+        {
+            ranges.back().count++;
+        }
+        else
+        {
+            MengerCellRange range = {cell, 1};
+            ranges.push_back(range);
+        }
+    }
+    occlusion_hidden = occlusion_tested - shown;
+    occlusion_test_ms = (glfwGetTime() - start) * 1000.0;
+}
+
+// process memory, CPU copies of the geometry still waiting for upload, and every GL buffer and texture of the
+// application with its size (estimated for the textures)
+void showMemoryPanel(size_t textureBytes, const SpongeBuffers& lodBuffers, const VoxelOccupancy& voxels,
+                     const ComputeSponge& compute)
+{
+    const char* modeNames[] = {"wierzcholki", "instancje", "proceduralnie", "indeksowane"};
+    const double MB = 1024.0 * 1024.0;
+
+    ImGui::SetNextWindowPos(ImVec2(SCR_WIDTH - 360.0f, 20.0f), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Pamiec");
+    ImGui::Text("Proces (RSS): %.1f MB", resident_bytes / MB);
+    ImGui::Text("Szczyt podczas generowania: %.1f MB", regeneration_peak_bytes / MB);
+    size_t staged = 0;
+    for (const CachedSponge& cached : sponge_cache)
+    {
+        if (cached.staging)
+            staged += geometryBytes(*cached.staging);
+    }
+    ImGui::Text("Kopie CPU czekajace na wyslanie: %.1f MB", staged / MB);
+
+    ImGui::Separator();
+    size_t total = 0;
+    for (const CachedSponge& cached : sponge_cache)
+    {
+        const SpongeBuffers& buffers = cached.buffers;
+        ImGui::Text("Poziom %d, %s%s", cached.key.depth, modeNames[cached.key.renderMode],
+                    buffers.mapped.buffer != 0 ? " (mapowany)" : "");
+        if (buffers.renderMode == RENDER_INSTANCED)
+        {
+            size_t cubeBytes = MENGER_CUBE_FLOATS * sizeof(float);
+            ImGui::BulletText("VBO %u: %.3f MB", buffers.VBO, cubeBytes / MB);
+            ImGui::BulletText("instancje %u: %.2f MB", buffers.instanceVBO, (buffers.vertexBytes - cubeBytes) / MB);
+        }
+        else
+        {
+            ImGui::BulletText("VBO %u: %.2f MB", buffers.VBO, buffers.vertexBytes / MB);
+            if (buffers.EBO != 0)
+                ImGui::BulletText("EBO %u: %.2f MB", buffers.EBO, buffers.indexBytes / MB);
+        }
+        total += buffers.vertexBytes + buffers.indexBytes;
+    }
+    ImGui::Text("LOD: VBO %u: %.3f MB, instancje %u: %.2f MB", lodBuffers.VBO, MENGER_CUBE_FLOATS * sizeof(float) / MB,
+                lodBuffers.instanceVBO, (lodBuffers.vertexBytes - MENGER_CUBE_FLOATS * sizeof(float)) / MB);
+    total += lodBuffers.vertexBytes;
+    if (voxels.texture != 0)
+    {
+        ImGui::Text("Voksele: drzewo 27 poziomu %d, bufor %u: %.2f KB", voxels.depth, voxels.buffer, voxels.bytes / 1024.0);
+        total += voxels.bytes;
+    }
+    if (compute.VBO != 0)
+    {
+        ImGui::Text("Compute shader: poziom %d, VBO/SSBO %u: %.2f MB", compute.depth, compute.VBO, compute.vertexBytes / MB);
+        total += compute.vertexBytes;
+    }
+    const GenerationJob* jobs[2] = {&regeneration, &precompute};
+    for (const GenerationJob* job : jobs)
+    {
+        if (job->result.valid() && job->target.buffer != 0)
+        {
+            ImGui::Text("Generowany poziom %d: bufor %u, %.2f MB", job->key.depth, job->target.buffer, job->target.bytes / MB);
+            total += job->target.bytes;
+        }
+    }
+    for (const GenerationJob& job : stale_jobs)
+        total += job.target.bytes;
+    for (const MappedBuffer& retired : retired_buffers)
+    {
+        ImGui::Text("Bufor %u do ponownego uzycia: %.2f MB", retired.buffer, retired.bytes / MB);
+        total += retired.bytes;
+    }
+
+    ImGui::Separator();
+    ImGuiIO& io = ImGui::GetIO();
+    size_t fontBytes = (size_t)io.Fonts->TexWidth * io.Fonts->TexHeight * 4;
+    ImGui::Text("Tekstura kamienia: %.2f MB (szacunek)", textureBytes / MB);
+    ImGui::Text("Tekstura czcionki ImGui: %.2f MB", fontBytes / MB);
+    total += textureBytes + fontBytes;
+    ImGui::Text("Razem GPU: %.1f MB", total / MB);
+    ImGui::End();
+}
+
+// extensions of a core profile context have to be queried one by one
+bool hasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return true;
+    }
+    return false;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -454,394 +1952,21 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
-void calculateBox(float x, float y, float z, float width)
-{
-//-----------------------------------------------
-    // FRONT
-    // left triangle
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(1.0f);
-
-//-----------------------------------------------
-    // FRONT
-    // right triangle
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(0.0f);
-
-//-----------------------------------------------
-    // BACK
-    // left triangle
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(1.0f);
-
-//-----------------------------------------------
-    // BACK
-    // right triangle
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(0.0f);
-
-//-----------------------------------------------
-    // LEFT
-    // left triangle
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(1.0f);
-
-//-----------------------------------------------
-    // LEFT
-    // right triangle
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(0.0f);
-
-//-----------------------------------------------
-    // RIGHT
-    // left triangle
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(1.0f);
-
-//-----------------------------------------------
-    // RIGHT
-    // right triangle
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(0.0f);
-
-//-----------------------------------------------
-    // BOTTOM
-    // left triangle
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(1.0f);
-
-    //-----------------------------------------------
-    // BOTTOM
-    // right triangle
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(0.0f);
-
-    //-----------------------------------------------
-    // TOP
-    // left triangle
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(0.0f);
-
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.0f);
-    vertices.push_back(1.0f);
-
-    //-----------------------------------------------
-    // TOP
-    // right triangle
-    vertices.push_back(x);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(0.5f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z + width);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(1.0f);
-
-    vertices.push_back(x + width);
-    vertices.push_back(y + width);
-    vertices.push_back(z);
-    vertices.push_back(clear_color.x);
-    vertices.push_back(clear_color.y);
-    vertices.push_back(clear_color.z);
-    vertices.push_back(1.0f);
-    vertices.push_back(0.0f);
-}
-
-void menger(float xpos, float ypos, float zpos, float width, int depth)
+// key of the sponge described by the current settings, with the settings that do not matter for its mode left at 0
+SpongeKey currentSpongeKey()
 {
-    // See if this is depth 1.
-    if (depth == 1)
+    SpongeKey key;
+    key.depth = max_depth;
+    key.renderMode = render_mode;
+    bool vertexModes = render_mode == RENDER_VERTICES || render_mode == RENDER_INDEXED;
+    key.geometryMode = vertexModes ? geometry_mode : 0;
+    // without compute shaders the same visible faces come from the CPU
+    if (render_mode == RENDER_COMPUTE && !has_compute_shaders)
     {
-        // Just make a cube.
-        calculateBox(xpos, ypos, zpos, width);
-    }
-    else
-    {
-        // Divide the cube.
-        double newWidth = width / 3.0;
-
-        for (int ix = 0; ix < 3; ix++)
-        {
-            for (int iy = 0; iy < 3; iy++)
-            {
-                if ((ix == 1) && (iy == 1)) continue;
-                for (int iz = 0; iz < 3; iz++)
-                {
-                    if ((iz == 1) && ((ix == 1) || (iy == 1))) continue;
-                    menger(xpos + newWidth * ix, ypos + newWidth * iy, zpos + newWidth * iz, newWidth, depth - 1);
-                }
-            }
-        }
+        key.renderMode = RENDER_VERTICES;
+        key.geometryMode = GEOMETRY_VISIBLE_FACES;
     }
+    key.compact = vertexModes && compact_vertices && geometry_mode != GEOMETRY_GREEDY;
+    key.indices32 = render_mode == RENDER_INDEXED && use_32bit_indices;
+    return key;
 }
-
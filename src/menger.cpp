@@ -0,0 +1,1086 @@
+#include "menger.h"
+#include "cube_emit.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace
+{
+    struct BoxVertex
+    {
+        int x, y, z; // 0 - cube origin, 1 - origin + width
+        float u, v;
+    };
+
+    // the 36 vertices written by calculateBox(), in the same order
+    const BoxVertex BOX_VERTICES[MENGER_CUBE_VERTICES] = {
+        // FRONT
+        {0, 0, 0, 0.0f, 0.0f}, {1, 0, 0, 0.5f, 0.0f}, {0, 1, 0, 0.0f, 1.0f},
+        {0, 1, 0, 0.5f, 1.0f}, {1, 1, 0, 1.0f, 1.0f}, {1, 0, 0, 1.0f, 0.0f},
+        // BACK
+        {0, 0, 1, 0.0f, 0.0f}, {1, 0, 1, 0.5f, 0.0f}, {0, 1, 1, 0.0f, 1.0f},
+        {0, 1, 1, 0.5f, 1.0f}, {1, 1, 1, 1.0f, 1.0f}, {1, 0, 1, 1.0f, 0.0f},
+        // LEFT
+        {0, 0, 1, 0.0f, 0.0f}, {0, 0, 0, 0.5f, 0.0f}, {0, 1, 1, 0.0f, 1.0f},
+        {0, 1, 1, 0.5f, 1.0f}, {0, 1, 0, 1.0f, 1.0f}, {0, 0, 0, 1.0f, 0.0f},
+        // RIGHT
+        {1, 0, 1, 0.0f, 0.0f}, {1, 0, 0, 0.5f, 0.0f}, {1, 1, 1, 0.0f, 1.0f},
+        {1, 1, 1, 0.5f, 1.0f}, {1, 1, 0, 1.0f, 1.0f}, {1, 0, 0, 1.0f, 0.0f},
+        // BOTTOM
+        {0, 0, 0, 0.0f, 0.0f}, {1, 0, 0, 0.5f, 0.0f}, {0, 0, 1, 0.0f, 1.0f},
+        {0, 0, 1, 0.5f, 1.0f}, {1, 0, 1, 1.0f, 1.0f}, {1, 0, 0, 1.0f, 0.0f},
+        // TOP
+        {0, 1, 0, 0.0f, 0.0f}, {1, 1, 0, 0.5f, 0.0f}, {0, 1, 1, 0.0f, 1.0f},
+        {0, 1, 1, 0.5f, 1.0f}, {1, 1, 1, 1.0f, 1.0f}, {1, 1, 0, 1.0f, 0.0f},
+    };
+
+    // the 4 corners of every face for indexed drawing, faces in the order of BOX_VERTICES
+    const BoxVertex QUAD_CORNERS[6][MENGER_QUAD_VERTICES] = {
+        {{0, 0, 0, 0.0f, 0.0f}, {1, 0, 0, 1.0f, 0.0f}, {1, 1, 0, 1.0f, 1.0f}, {0, 1, 0, 0.0f, 1.0f}},
+        {{0, 0, 1, 0.0f, 0.0f}, {1, 0, 1, 1.0f, 0.0f}, {1, 1, 1, 1.0f, 1.0f}, {0, 1, 1, 0.0f, 1.0f}},
+        {{0, 0, 1, 0.0f, 0.0f}, {0, 0, 0, 1.0f, 0.0f}, {0, 1, 0, 1.0f, 1.0f}, {0, 1, 1, 0.0f, 1.0f}},
+        {{1, 0, 1, 0.0f, 0.0f}, {1, 0, 0, 1.0f, 0.0f}, {1, 1, 0, 1.0f, 1.0f}, {1, 1, 1, 0.0f, 1.0f}},
+        {{0, 0, 0, 0.0f, 0.0f}, {1, 0, 0, 1.0f, 0.0f}, {1, 0, 1, 1.0f, 1.0f}, {0, 0, 1, 0.0f, 1.0f}},
+        {{0, 1, 0, 0.0f, 0.0f}, {1, 1, 0, 1.0f, 0.0f}, {1, 1, 1, 1.0f, 1.0f}, {0, 1, 1, 0.0f, 1.0f}},
+    };
+
+    // writes one vertex of the interleaved layout and returns the advanced cursor
+    float* writeVertex(float* cursor, float x, float y, float z, float u, float v)
+    {
+        cursor[0] = x;
+        cursor[1] = y;
+        cursor[2] = z;
+        cursor[3] = u;
+        cursor[4] = v;
+        return cursor + MENGER_VERTEX_FLOATS;
+    }
+
+    CompactVertex* writeCompactVertex(CompactVertex* cursor, long x, long y, long z, float u, float v)
+    {
+        cursor->x = (unsigned short)x;
+        cursor->y = (unsigned short)y;
+        cursor->z = (unsigned short)z;
+        cursor->u = (unsigned char)(u * 255.0f + 0.5f);
+        cursor->v = (unsigned char)(v * 255.0f + 0.5f);
+        return cursor + 1;
+    }
+
+    struct SubCube
+    {
+        int x, y, z;
+    };
+
+    // the 20 sub-cubes kept at every level, in the loop order of the recursive menger()
+    const SubCube MENGER_SUBCUBES[20] = {
+        {0, 0, 0}, {0, 0, 1}, {0, 0, 2}, {0, 1, 0}, {0, 1, 2}, {0, 2, 0}, {0, 2, 1}, {0, 2, 2},
+        {1, 0, 0}, {1, 0, 2}, {1, 2, 0}, {1, 2, 2},
+        {2, 0, 0}, {2, 0, 1}, {2, 0, 2}, {2, 1, 0}, {2, 1, 2}, {2, 2, 0}, {2, 2, 1}, {2, 2, 2},
+    };
+
+    // number of set bits of a 6-bit face mask
+    const int FACE_COUNT[64] = {
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+        1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    };
+
+    // outward direction of the faces of BOX_VERTICES: front, back, left, right, bottom, top
+    const SubCube FACE_DIRECTIONS[6] = {
+        {0, 0, -1}, {0, 0, 1}, {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0},
+    };
+
+    // lattice axes (0 - x, 1 - y, 2 - z) of every face direction: the normal and the two axes spanning the face
+    struct FaceAxes
+    {
+        int normal, a, b;
+    };
+
+    const FaceAxes FACE_AXES[6] = {
+        {2, 0, 1}, {2, 0, 1}, {0, 2, 1}, {0, 2, 1}, {1, 0, 2}, {1, 0, 2},
+    };
+
+    // walks the cubes of the sponge in the order of the recursive menger(), as an odometer over the base-20
+    // cube index: digit[l] picks the sub-cube at level l, x/y/z/w[l] hold the origin and width of that sub-cube
+    // and i/j/k[l] its coordinates on the 3^l lattice (level 0 is the whole sponge)
+    class MengerWalker
+    {
+    public:
+        MengerWalker(float xpos, float ypos, float zpos, float width, int depth, size_t firstCube)
+            : levels(depth - 1)
+        {
+            xs[0] = xpos;
+            ys[0] = ypos;
+            zs[0] = zpos;
+            ws[0] = width;
+            is[0] = js[0] = ks[0] = 0;
+
+            for (int l = levels; l >= 1; l--)
+            {
+                digit[l] = (int)(firstCube % 20);
+                firstCube /= 20;
+            }
+            update(1);
+        }
+
+        float x() const { return xs[levels]; }
+        float y() const { return ys[levels]; }
+        float z() const { return zs[levels]; }
+        float width() const { return ws[levels]; }
+        long i() const { return is[levels]; }
+        long j() const { return js[levels]; }
+        long k() const { return ks[levels]; }
+
+        // advance to the next cube, only the levels whose digit changed are recomputed
+        void next()
+        {
+            int level = levels;
+            while (level >= 1 && ++digit[level] == 20)
+            {
+                digit[level] = 0;
+                level--;
+            }
+            if (level >= 1)
+                update(level);
+        }
+
+    private:
+        // same arithmetic as menger(): double width, rounded to float at every level
+        void update(int from)
+        {
+            for (int l = from; l <= levels; l++)
+            {
+                const SubCube& s = MENGER_SUBCUBES[digit[l]];
+                double newWidth = ws[l - 1] / 3.0;
+                xs[l] = (float)(xs[l - 1] + newWidth * s.x);
+                ys[l] = (float)(ys[l - 1] + newWidth * s.y);
+                zs[l] = (float)(zs[l - 1] + newWidth * s.z);
+                ws[l] = (float)newWidth;
+                is[l] = is[l - 1] * 3 + s.x;
+                js[l] = js[l - 1] * 3 + s.y;
+                ks[l] = ks[l - 1] * 3 + s.z;
+            }
+        }
+
+        int levels;
+        int digit[MENGER_MAX_DEPTH];
+        float xs[MENGER_MAX_DEPTH], ys[MENGER_MAX_DEPTH], zs[MENGER_MAX_DEPTH], ws[MENGER_MAX_DEPTH];
+        long is[MENGER_MAX_DEPTH], js[MENGER_MAX_DEPTH], ks[MENGER_MAX_DEPTH];
+    };
+
+    // occupancy of the 3^(depth-1) lattice: a cell is solid unless two or more of its base-3 digits
+    // are 1 at the same level; ones[i] has bit l set when digit l of i is 1
+    struct MengerLattice
+    {
+        explicit MengerLattice(int depth)
+        {
+            size = mengerLatticeSize(depth);
+
+            ones.resize(size);
+            for (long i = 0; i < size; i++)
+            {
+                unsigned int bits = 0;
+                for (long n = i, l = 0; n > 0; n /= 3, l++)
+                    if (n % 3 == 1)
+                        bits |= 1u << l;
+                ones[i] = (unsigned short)bits;
+            }
+        }
+
+        bool solid(long i, long j, long k) const
+        {
+            if (i < 0 || j < 0 || k < 0 || i >= size || j >= size || k >= size)
+                return false;
+            return ((ones[i] & ones[j]) | (ones[j] & ones[k]) | (ones[i] & ones[k])) == 0;
+        }
+
+        // mask of the faces of cell (i, j, k) that do not touch a solid neighbour
+        int visibleFaces(long i, long j, long k) const
+        {
+            int mask = 0;
+            for (int face = 0; face < 6; face++)
+            {
+                const SubCube& d = FACE_DIRECTIONS[face];
+                if (!solid(i + d.x, j + d.y, k + d.z))
+                    mask |= 1 << face;
+            }
+            return mask;
+        }
+
+        long size;
+        std::vector<unsigned short> ones;
+    };
+
+    // splits the sponge into tasks of whole sub-trees: one task per sub-cube of the first level,
+    // or of the second level if 20 tasks would balance poorly between the threads
+    struct TaskSplit
+    {
+        TaskSplit(int depth, unsigned int threads)
+        {
+            threadCount = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+            int taskLevels = std::min(depth - 1, 20 >= 4 * threadCount ? 1 : 2);
+            taskCount = mengerCubeCount(taskLevels + 1);
+            cubesPerTask = mengerCubeCount(depth) / taskCount;
+        }
+
+        unsigned int threadCount;
+        size_t taskCount;
+        size_t cubesPerTask;
+    };
+
+    // announces the number of tasks of all passes of a generator before the first one starts
+    void startProgress(MengerProgress* progress, size_t taskCount)
+    {
+        if (progress != NULL)
+            progress->total += taskCount;
+    }
+
+    // runs task(0) .. task(taskCount - 1) on a pool of threads, the calling thread works as well;
+    // finished tasks are counted in progress, and once it is cancelled the remaining tasks are skipped
+    template <typename Task>
+    void runTasks(size_t taskCount, unsigned int threadCount, Task task, MengerProgress* progress)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        threadCount = (unsigned int)std::min<size_t>(threadCount, taskCount);
+
+        std::atomic<size_t> nextTask(0);
+        auto worker = [&]()
+        {
+            for (size_t n = nextTask++; n < taskCount; n = nextTask++)
+            {
+                if (progress != NULL && progress->cancelled)
+                    break;
+                task(n);
+                if (progress != NULL)
+                    progress->done++;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    // same faces and order as writeBoxFaces(), for the cube in lattice cell (i, j, k)
+    CompactVertex* writeCompactFaces(CompactVertex* cursor, long i, long j, long k, int faceMask, FaceLayout layout)
+    {
+        for (int face = 0; face < 6; face++)
+        {
+            if (!(faceMask & (1 << face)))
+                continue;
+
+            if (layout == FACE_QUADS)
+            {
+                for (const BoxVertex& v : QUAD_CORNERS[face])
+                    cursor = writeCompactVertex(cursor, i + v.x, j + v.y, k + v.z, v.u, v.v);
+                continue;
+            }
+
+            for (int n = face * 6; n < face * 6 + 6; n++)
+            {
+                const BoxVertex& v = BOX_VERTICES[n];
+                cursor = writeCompactVertex(cursor, i + v.x, j + v.y, k + v.z, v.u, v.v);
+            }
+        }
+
+        return cursor;
+    }
+
+    void addCells(std::vector<MengerCellRange>& ranges, size_t first, size_t count)
+    {
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == first)
+        {
+            ranges.back().count += count;
+            return;
+        }
+        MengerCellRange range = {first, count};
+        ranges.push_back(range);
+    }
+
+    // node levelsLeft levels above the cells, its first cell is firstCell
+    void cullNode(std::vector<MengerCellRange>& ranges, MengerCullStats& stats, const MengerFrustum& frustum,
+                  float x, float y, float z, float width, int levelsLeft, size_t firstCell)
+    {
+        size_t cells = mengerCubeCount(levelsLeft + 1);
+        stats.testedNodes++;
+        int side = mengerClassifyBox(frustum, x, y, z, width);
+        if (side < 0)
+        {
+            stats.culledCells += cells;
+            return;
+        }
+        if (side > 0 || levelsLeft == 0)
+        {
+            addCells(ranges, firstCell, cells);
+            stats.visibleCells += cells;
+            return;
+        }
+
+        // same arithmetic as menger() and MengerWalker
+        double newWidth = width / 3.0;
+        for (int n = 0; n < 20; n++)
+        {
+            const SubCube& s = MENGER_SUBCUBES[n];
+            cullNode(ranges, stats, frustum, (float)(x + newWidth * s.x), (float)(y + newWidth * s.y),
+                     (float)(z + newWidth * s.z), (float)newWidth, levelsLeft - 1, firstCell + n * (cells / 20));
+        }
+    }
+}
+
+void VertexData::allocate(size_t floatCount)
+{
+    owned.reset();
+    if (target != NULL && floatCount * sizeof(float) <= targetBytes)
+    {
+        data = (float*)target;
+    }
+    else
+    {
+        // new float[] leaves the memory uninitialized, every float is written by the generator anyway
+        owned.reset(new float[floatCount]);
+        data = owned.get();
+    }
+    size = floatCount;
+}
+
+void VertexData::clear()
+{
+    owned.reset();
+    data = NULL;
+    size = 0;
+}
+
+void CompactVertexData::allocate(size_t vertexCount)
+{
+    owned.reset();
+    if (target != NULL && vertexCount * sizeof(CompactVertex) <= targetBytes)
+    {
+        data = (CompactVertex*)target;
+    }
+    else
+    {
+        owned.reset(new CompactVertex[vertexCount]);
+        data = owned.get();
+    }
+    size = vertexCount;
+}
+
+void CompactVertexData::clear()
+{
+    owned.reset();
+    data = NULL;
+    size = 0;
+}
+
+size_t mengerCubeCount(int depth)
+{
+    size_t count = 1;
+    for (int i = 1; i < depth; i++)
+        count *= 20;
+    return count;
+}
+
+size_t mengerFloatCount(int depth)
+{
+    return mengerCubeCount(depth) * MENGER_CUBE_FLOATS;
+}
+
+long mengerLatticeSize(int depth)
+{
+    return (long)mengerPower3(depth - 1);
+}
+
+long long mengerPower3(int exponent)
+{
+    long long result = 1;
+    for (int n = 0; n < exponent; n++)
+        result *= 3;
+    return result;
+}
+
+bool mengerSolidCell(long long i, long long j, long long k, int levels)
+{
+    const long long size = mengerPower3(levels);
+    if (i < 0 || j < 0 || k < 0 || i >= size || j >= size || k >= size)
+        return false;
+    for (int l = 0; l < levels; l++, i /= 3, j /= 3, k /= 3)
+    {
+        if ((i % 3 == 1) + (j % 3 == 1) + (k % 3 == 1) >= 2)
+            return false;
+    }
+    return true;
+}
+
+int mengerFaceFloats(FaceLayout layout)
+{
+    return layout == FACE_QUADS ? MENGER_QUAD_FLOATS : MENGER_FACE_FLOATS;
+}
+
+float* writeBox(float* cursor, float x, float y, float z, float width)
+{
+    return writeBoxFaces(cursor, x, y, z, width, 0x3f);
+}
+
+float* mengerWriteRange(float* cursor, float xpos, float ypos, float zpos, float width, int depth,
+                        size_t firstCube, size_t cubeCount, FaceLayout layout, bool stream)
+{
+    MengerWalker walker(xpos, ypos, zpos, width, depth, firstCube);
+    if (layout == FACE_QUADS)
+    {
+        for (size_t n = 0; n < cubeCount; n++, walker.next())
+            cursor = writeBoxFaces(cursor, walker.x(), walker.y(), walker.z(), walker.width(), 0x3f, layout);
+        return cursor;
+    }
+
+    // whole cubes go to the emission kernel in batches, origins and widths as structure of arrays
+    const size_t BATCH = 256;
+    float xs[BATCH], ys[BATCH], zs[BATCH], ws[BATCH];
+    for (size_t n = 0; n < cubeCount;)
+    {
+        size_t batch = std::min(cubeCount - n, BATCH);
+        for (size_t k = 0; k < batch; k++, walker.next())
+        {
+            xs[k] = walker.x();
+            ys[k] = walker.y();
+            zs[k] = walker.z();
+            ws[k] = walker.width();
+        }
+        cursor = emitCubes(cursor, xs, ys, zs, ws, batch, stream);
+        n += batch;
+    }
+
+    return cursor;
+}
+
+void mengerExact(VertexData& out, float xpos, float ypos, float zpos, float width, int depth)
+{
+    out.allocate(mengerFloatCount(depth));
+    // a caller's buffer is already backed, a fresh allocation is written through the cache its page faults fill
+    mengerWriteRange(out.data, xpos, ypos, zpos, width, depth, 0, mengerCubeCount(depth), FACE_TRIANGLES,
+                     out.inTarget());
+}
+
+void mengerParallel(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                    unsigned int threadCount, FaceLayout layout, MengerProgress* progress)
+{
+    const size_t cubeFloats = 6 * mengerFaceFloats(layout);
+    out.allocate(mengerCubeCount(depth) * cubeFloats);
+
+    const TaskSplit split(depth, threadCount);
+    startProgress(progress, split.taskCount);
+    float* base = out.data;
+    const bool stream = out.inTarget();
+    runTasks(split.taskCount, split.threadCount, [&](size_t task)
+    {
+        size_t first = task * split.cubesPerTask;
+        mengerWriteRange(base + first * cubeFloats, xpos, ypos, zpos, width, depth, first, split.cubesPerTask, layout,
+                         stream);
+    }, progress);
+}
+
+void mengerInstances(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                     unsigned int threadCount, MengerProgress* progress)
+{
+    out.allocate(mengerCubeCount(depth) * MENGER_INSTANCE_FLOATS);
+
+    const TaskSplit split(depth, threadCount);
+    startProgress(progress, split.taskCount);
+    float* base = out.data;
+    runTasks(split.taskCount, split.threadCount, [&](size_t task)
+    {
+        MengerWalker walker(xpos, ypos, zpos, width, depth, task * split.cubesPerTask);
+        float* cursor = base + task * split.cubesPerTask * MENGER_INSTANCE_FLOATS;
+        for (size_t n = 0; n < split.cubesPerTask; n++, walker.next())
+        {
+            cursor[0] = walker.x();
+            cursor[1] = walker.y();
+            cursor[2] = walker.z();
+            cursor[3] = walker.width();
+            cursor += MENGER_INSTANCE_FLOATS;
+        }
+    }, progress);
+}
+
+size_t mengerVisibleFaceCount(int depth)
+{
+    // surface of the sponge in unit faces: 2 * 20^n + 4 * 8^n for n = depth - 1 subdivisions
+    size_t faces20 = 2, faces8 = 4;
+    for (int i = 1; i < depth; i++)
+    {
+        faces20 *= 20;
+        faces8 *= 8;
+    }
+    return faces20 + faces8;
+}
+
+float* writeBoxFaces(float* cursor, float x, float y, float z, float width, int faceMask,
+                     FaceLayout layout)
+{
+    const float xs[2] = {x, x + width};
+    const float ys[2] = {y, y + width};
+    const float zs[2] = {z, z + width};
+
+    for (int face = 0; face < 6; face++)
+    {
+        if (!(faceMask & (1 << face)))
+            continue;
+
+        if (layout == FACE_QUADS)
+        {
+            for (const BoxVertex& v : QUAD_CORNERS[face])
+                cursor = writeVertex(cursor, xs[v.x], ys[v.y], zs[v.z], v.u, v.v);
+            continue;
+        }
+
+        for (int i = face * 6; i < face * 6 + 6; i++)
+        {
+            const BoxVertex& v = BOX_VERTICES[i];
+            cursor = writeVertex(cursor, xs[v.x], ys[v.y], zs[v.z], v.u, v.v);
+        }
+    }
+
+    return cursor;
+}
+
+void mengerVisibleFaces(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                        unsigned int threadCount, FaceLayout layout, MengerProgress* progress)
+{
+    const MengerLattice lattice(depth);
+    const TaskSplit split(depth, threadCount);
+    startProgress(progress, 2 * split.taskCount);
+    const size_t faceFloats = mengerFaceFloats(layout);
+
+    // first pass counts the faces of every task, so that each one knows where its slice starts
+    std::vector<size_t> taskFirstFace(split.taskCount + 1, 0);
+    runTasks(split.taskCount, split.threadCount, [&](size_t task)
+    {
+        MengerWalker walker(xpos, ypos, zpos, width, depth, task * split.cubesPerTask);
+        size_t faces = 0;
+        for (size_t n = 0; n < split.cubesPerTask; n++, walker.next())
+            faces += FACE_COUNT[lattice.visibleFaces(walker.i(), walker.j(), walker.k())];
+        taskFirstFace[task + 1] = faces;
+    }, progress);
+    for (size_t task = 0; task < split.taskCount; task++)
+        taskFirstFace[task + 1] += taskFirstFace[task];
+
+    out.allocate(taskFirstFace[split.taskCount] * faceFloats);
+
+    float* base = out.data;
+    runTasks(split.taskCount, split.threadCount, [&](size_t task)
+    {
+        MengerWalker walker(xpos, ypos, zpos, width, depth, task * split.cubesPerTask);
+        float* cursor = base + taskFirstFace[task] * faceFloats;
+        for (size_t n = 0; n < split.cubesPerTask; n++, walker.next())
+        {
+            int faceMask = lattice.visibleFaces(walker.i(), walker.j(), walker.k());
+            cursor = writeBoxFaces(cursor, walker.x(), walker.y(), walker.z(), walker.width(), faceMask, layout);
+        }
+    }, progress);
+}
+
+void mengerCompact(CompactVertexData& out, int depth, bool visibleOnly, unsigned int threadCount, FaceLayout layout,
+                   MengerProgress* progress)
+{
+    const MengerLattice lattice(depth);
+    const TaskSplit split(depth, threadCount);
+    startProgress(progress, 2 * split.taskCount);
+    const size_t faceVertices = layout == FACE_QUADS ? MENGER_QUAD_VERTICES : 6;
+
+    // only the lattice coordinates of the walker are used, so any origin and width will do
+    std::vector<size_t> taskFirstFace(split.taskCount + 1, 0);
+    runTasks(split.taskCount, split.threadCount, [&](size_t task)
+    {
+        MengerWalker walker(0.0f, 0.0f, 0.0f, 1.0f, depth, task * split.cubesPerTask);
+        size_t faces = 0;
+        for (size_t n = 0; n < split.cubesPerTask; n++, walker.next())
+            faces += visibleOnly ? FACE_COUNT[lattice.visibleFaces(walker.i(), walker.j(), walker.k())] : 6;
+        taskFirstFace[task + 1] = faces;
+    }, progress);
+    for (size_t task = 0; task < split.taskCount; task++)
+        taskFirstFace[task + 1] += taskFirstFace[task];
+
+    out.allocate(taskFirstFace[split.taskCount] * faceVertices);
+
+    CompactVertex* base = out.data;
+    runTasks(split.taskCount, split.threadCount, [&](size_t task)
+    {
+        MengerWalker walker(0.0f, 0.0f, 0.0f, 1.0f, depth, task * split.cubesPerTask);
+        CompactVertex* cursor = base + taskFirstFace[task] * faceVertices;
+        for (size_t n = 0; n < split.cubesPerTask; n++, walker.next())
+        {
+            int faceMask = visibleOnly ? lattice.visibleFaces(walker.i(), walker.j(), walker.k()) : 0x3f;
+            cursor = writeCompactFaces(cursor, walker.i(), walker.j(), walker.k(), faceMask, layout);
+        }
+    }, progress);
+}
+
+void mengerGreedy(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                  unsigned int threadCount, FaceLayout layout, MengerProgress* progress)
+{
+    const MengerLattice lattice(depth);
+    const long n = lattice.size;
+
+    // one task per face direction and lattice slice, each one collects the rectangles of its plane
+    struct Rect
+    {
+        long a, b, w, h;
+    };
+    std::vector<std::vector<Rect>> rects(6 * n);
+    startProgress(progress, 2 * rects.size());
+
+    runTasks(rects.size(), threadCount, [&](size_t task)
+    {
+        const int face = (int)(task / n);
+        const long slice = (long)(task % n);
+        const FaceAxes& axes = FACE_AXES[face];
+        const SubCube& d = FACE_DIRECTIONS[face];
+
+        // visible faces of the slice, indexed [b * n + a]
+        std::vector<unsigned char> mask(n * n);
+        long cell[3];
+        cell[axes.normal] = slice;
+        for (long b = 0; b < n; b++)
+        {
+            cell[axes.b] = b;
+            for (long a = 0; a < n; a++)
+            {
+                cell[axes.a] = a;
+                mask[b * n + a] = lattice.solid(cell[0], cell[1], cell[2]) &&
+                                  !lattice.solid(cell[0] + d.x, cell[1] + d.y, cell[2] + d.z);
+            }
+        }
+
+        // grow every unmerged face along a, then along b while the whole row is still free
+        std::vector<Rect>& result = rects[task];
+        for (long b = 0; b < n; b++)
+        {
+            for (long a = 0; a < n; a++)
+            {
+                if (!mask[b * n + a])
+                    continue;
+
+                long w = 1;
+                while (a + w < n && mask[b * n + a + w])
+                    w++;
+
+                long h = 1;
+                for (; b + h < n; h++)
+                {
+                    const unsigned char* row = &mask[(b + h) * n + a];
+                    if (std::find(row, row + w, 0) != row + w)
+                        break;
+                }
+
+                for (long y = b; y < b + h; y++)
+                    std::fill(&mask[y * n + a], &mask[y * n + a + w], 0);
+
+                Rect rect = {a, b, w, h};
+                result.push_back(rect);
+                a += w - 1;
+            }
+        }
+    }, progress);
+
+    std::vector<size_t> taskFirstRect(rects.size() + 1, 0);
+    for (size_t task = 0; task < rects.size(); task++)
+        taskFirstRect[task + 1] = taskFirstRect[task] + rects[task].size();
+    const size_t faceFloats = mengerFaceFloats(layout);
+    out.allocate(taskFirstRect[rects.size()] * faceFloats);
+
+    const double origin[3] = {xpos, ypos, zpos};
+    const double cellWidth = (double)width / n;
+    float* base = out.data;
+    runTasks(rects.size(), threadCount, [&](size_t task)
+    {
+        const int face = (int)(task / n);
+        const FaceAxes& axes = FACE_AXES[face];
+        // faces pointing in the positive direction lie on the far side of their cell
+        const long plane = (long)(task % n) + (face % 2);
+
+        // triangles (0, 1, 2), (0, 2, 3) of the rectangle, the quad layout leaves them to the index buffer
+        const int triangleCorners[6] = {0, 1, 2, 0, 2, 3};
+        const int quadCorners[4] = {0, 1, 2, 3};
+        const int* order = layout == FACE_QUADS ? quadCorners : triangleCorners;
+        const int vertexCount = layout == FACE_QUADS ? MENGER_QUAD_VERTICES : 6;
+
+        float* cursor = base + taskFirstRect[task] * faceFloats;
+        for (const Rect& rect : rects[task])
+        {
+            const long corners[4][2] = {
+                {rect.a, rect.b}, {rect.a + rect.w, rect.b}, {rect.a + rect.w, rect.b + rect.h}, {rect.a, rect.b + rect.h},
+            };
+            for (int v = 0; v < vertexCount; v++)
+            {
+                const long* corner = corners[order[v]];
+                long point[3];
+                point[axes.normal] = plane;
+                point[axes.a] = corner[0];
+                point[axes.b] = corner[1];
+
+                // one texture repeat per lattice cell, continuous across neighbouring rectangles
+                cursor = writeVertex(cursor, (float)(origin[0] + point[0] * cellWidth), (float)(origin[1] + point[1] * cellWidth),
+                                     (float)(origin[2] + point[2] * cellWidth), (float)corner[0], (float)corner[1]);
+            }
+        }
+    }, progress);
+}
+
+// planes failing for the corner of the box farthest along their normal reject the box, planes passing for the
+// nearest corner accept it
+int mengerClassifyBox(const MengerFrustum& frustum, float x, float y, float z, float width)
+{
+    int result = 1;
+    for (const float* plane : frustum.planes)
+    {
+        float farX = plane[0] >= 0.0f ? x + width : x;
+        float farY = plane[1] >= 0.0f ? y + width : y;
+        float farZ = plane[2] >= 0.0f ? z + width : z;
+        if (plane[0] * farX + plane[1] * farY + plane[2] * farZ + plane[3] < 0.0f)
+            return -1;
+        float nearX = plane[0] >= 0.0f ? x : x + width;
+        float nearY = plane[1] >= 0.0f ? y : y + width;
+        float nearZ = plane[2] >= 0.0f ? z : z + width;
+        if (plane[0] * nearX + plane[1] * nearY + plane[2] * nearZ + plane[3] < 0.0f)
+            result = 0;
+    }
+    return result;
+}
+
+void mengerCull(std::vector<MengerCellRange>& ranges, MengerCullStats& stats, const MengerFrustum& frustum,
+                float xpos, float ypos, float zpos, float width, int cellLevels)
+{
+    cullNode(ranges, stats, frustum, xpos, ypos, zpos, width, cellLevels, 0);
+}
+
+void mengerCellFaceOffsets(std::vector<size_t>& offsets, int depth, int cellLevels, bool visibleOnly,
+                           unsigned int threadCount)
+{
+    const size_t cellCount = mengerCubeCount(cellLevels + 1);
+    const size_t cubesPerCell = mengerCubeCount(depth) / cellCount;
+    offsets.assign(cellCount + 1, 0);
+    if (!visibleOnly)
+    {
+        for (size_t cell = 0; cell <= cellCount; cell++)
+            offsets[cell] = cell * cubesPerCell * 6;
+        return;
+    }
+
+    const MengerLattice lattice(depth);
+    runTasks(cellCount, threadCount, [&](size_t cell)
+    {
+        MengerWalker walker(0.0f, 0.0f, 0.0f, 1.0f, depth, cell * cubesPerCell);
+        size_t faces = 0;
+        for (size_t n = 0; n < cubesPerCell; n++, walker.next())
+            faces += FACE_COUNT[lattice.visibleFaces(walker.i(), walker.j(), walker.k())];
+        offsets[cell + 1] = faces;
+    }, NULL);
+    for (size_t cell = 0; cell < cellCount; cell++)
+        offsets[cell + 1] += offsets[cell];
+}
+
+void mengerOccupancy(std::vector<unsigned int>& nodes, int depth)
+{
+    unsigned int mask = 0;
+    for (const SubCube& s : MENGER_SUBCUBES)
+        mask |= 1u << (s.x + 3 * s.y + 9 * s.z);
+
+    // node l stands for every solid sub-cube of level l, its solid sub-cubes all point to node l + 1
+    const int levels = depth > 1 ? depth - 1 : 0;
+    nodes.assign((size_t)levels * MENGER_OCCUPANCY_NODE, MENGER_OCCUPANCY_EMPTY);
+    for (int l = 0; l < levels; l++)
+    {
+        unsigned int* node = &nodes[(size_t)l * MENGER_OCCUPANCY_NODE];
+        node[0] = mask;
+        if (l + 1 == levels)
+            continue;
+        for (int child = 0; child < 27; child++)
+            if (mask & (1u << child))
+                node[1 + child] = (unsigned int)((l + 1) * MENGER_OCCUPANCY_NODE);
+    }
+}
+
+void calculateBox(std::vector<float>& vertices, float x, float y, float z, float width)
+{
+//-----------------------------------------------
+    // FRONT
+    // left triangle
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(0.0f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(0.5f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(0.0f);
+    vertices.push_back(1.0f);
+
+//-----------------------------------------------
+    // FRONT
+    // right triangle
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(0.5f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(0.0f);
+
+//-----------------------------------------------
+    // BACK
+    // left triangle
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(0.5f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(1.0f);
+
+//-----------------------------------------------
+    // BACK
+    // right triangle
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.5f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(1.0f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(1.0f);
+    vertices.push_back(0.0f);
+
+//-----------------------------------------------
+    // LEFT
+    // left triangle
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(0.5f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(1.0f);
+
+//-----------------------------------------------
+    // LEFT
+    // right triangle
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.5f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(0.0f);
+
+//-----------------------------------------------
+    // RIGHT
+    // left triangle
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(0.5f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(1.0f);
+
+//-----------------------------------------------
+    // RIGHT
+    // right triangle
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.5f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(0.0f);
+
+//-----------------------------------------------
+    // BOTTOM
+    // left triangle
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(0.0f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(0.5f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(1.0f);
+
+    //-----------------------------------------------
+    // BOTTOM
+    // right triangle
+    vertices.push_back(x);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(0.5f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z + width);
+    vertices.push_back(1.0f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(0.0f);
+
+    //-----------------------------------------------
+    // TOP
+    // left triangle
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(0.0f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(0.5f);
+    vertices.push_back(0.0f);
+
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.0f);
+    vertices.push_back(1.0f);
+
+    //-----------------------------------------------
+    // TOP
+    // right triangle
+    vertices.push_back(x);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(0.5f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z + width);
+    vertices.push_back(1.0f);
+    vertices.push_back(1.0f);
+
+    vertices.push_back(x + width);
+    vertices.push_back(y + width);
+    vertices.push_back(z);
+    vertices.push_back(1.0f);
+    vertices.push_back(0.0f);
+}
+
+void menger(std::vector<float>& vertices, float xpos, float ypos, float zpos, float width, int depth)
+{
+    // See if this is depth 1.
+    if (depth == 1)
+    {
+        // Just make a cube.
+        calculateBox(vertices, xpos, ypos, zpos, width);
+    }
+    else
+    {
+        // Divide the cube.
+        double newWidth = width / 3.0;
+
+        for (int ix = 0; ix < 3; ix++)
+        {
+            for (int iy = 0; iy < 3; iy++)
+            {
+                if ((ix == 1) && (iy == 1)) continue;
+                for (int iz = 0; iz < 3; iz++)
+                {
+                    if ((iz == 1) && ((ix == 1) || (iy == 1))) continue;
+                    menger(vertices, xpos + newWidth * ix, ypos + newWidth * iy, zpos + newWidth * iz, newWidth, depth - 1);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,225 @@
+// Menger sponge geometry generation
+// Produces interleaved vertex data (position, texture coordinates) ready for glBufferData(); the colour is a
+// shader uniform and is not part of the vertices.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// vertex layout: position (3 floats), texture coordinates (2 floats)
+const int MENGER_VERTEX_FLOATS = 5;
+// 6 faces x 2 triangles x 3 vertices
+const int MENGER_CUBE_VERTICES = 36;
+const int MENGER_CUBE_FLOATS = MENGER_CUBE_VERTICES * MENGER_VERTEX_FLOATS;
+// 2 triangles x 3 vertices
+const int MENGER_FACE_FLOATS = 6 * MENGER_VERTEX_FLOATS;
+// indexed drawing: every face is a quad of 4 corners with its own texture coordinates (24 vertices per cube),
+// split into 2 triangles by 6 indices
+const int MENGER_QUAD_VERTICES = 4;
+const int MENGER_QUAD_FLOATS = MENGER_QUAD_VERTICES * MENGER_VERTEX_FLOATS;
+const int MENGER_QUAD_INDICES = 6;
+// 16-bit indices address 65536 vertices, larger meshes are drawn in chunks of this many quads with a base vertex
+const int MENGER_QUADS_PER_CHUNK = 65536 / MENGER_QUAD_VERTICES;
+// per-instance data of instanced rendering: cube origin (3 floats) and width
+const int MENGER_INSTANCE_FLOATS = 4;
+// 20^(depth-1) cubes still fits in size_t up to this depth
+const int MENGER_MAX_DEPTH = 12;
+// the 3^(depth-1) lattice corners still fit in unsigned short up to this depth
+const int MENGER_COMPACT_MAX_DEPTH = 11;
+
+// how the faces are written to the vertex data
+enum FaceLayout
+{
+    FACE_TRIANGLES, // 2 separate triangles, 6 vertices for glDrawArrays()
+    FACE_QUADS      // 4 corners, triangles assembled by mengerQuadIndices()
+};
+
+// vertex data allocated once with its exact size (no zero-initialization, no regrowth);
+// when target is set before generation (e.g. a mapped GL buffer) and the data fits in targetBytes, the generator
+// writes straight into it and the memory stays owned by the caller
+struct VertexData
+{
+    float* data = NULL;
+    size_t size = 0; // number of floats
+    void* target = NULL;
+    size_t targetBytes = 0;
+
+    void allocate(size_t floatCount);
+    void clear();
+    size_t vertexCount() const { return size / MENGER_VERTEX_FLOATS; }
+    bool inTarget() const { return data != NULL && data == target; }
+
+private:
+    std::unique_ptr<float[]> owned;
+};
+
+// compact vertex, 8 bytes: corner on the integer lattice and texture coordinates as normalized bytes;
+// the vertex shader turns the lattice corner into a position with the sponge origin and cell width uniforms
+struct CompactVertex
+{
+    unsigned short x, y, z;
+    unsigned char u, v;
+};
+
+struct CompactVertexData
+{
+    CompactVertex* data = NULL;
+    size_t size = 0; // number of vertices
+    void* target = NULL; // as in VertexData
+    size_t targetBytes = 0;
+
+    void allocate(size_t vertexCount);
+    void clear();
+    bool inTarget() const { return data != NULL && data == target; }
+
+private:
+    std::unique_ptr<CompactVertex[]> owned;
+};
+
+// shared with a generator running on another thread: its finished and total tasks, and a flag that makes it skip
+// the remaining tasks (the output of a cancelled generator is incomplete and has to be discarded)
+struct MengerProgress
+{
+    std::atomic<size_t> done;
+    std::atomic<size_t> total;
+    std::atomic<bool> cancelled;
+
+    MengerProgress() : done(0), total(0), cancelled(false) {}
+    float fraction() const
+    {
+        size_t all = total;
+        return all > 0 ? (float)done / all : 0.0f;
+    }
+};
+
+// number of solid cubes of a sponge of given depth: 20^(depth-1)
+size_t mengerCubeCount(int depth);
+// number of floats needed to store the whole sponge
+size_t mengerFloatCount(int depth);
+// number of lattice cells along one edge of the sponge: 3^(depth-1)
+long mengerLatticeSize(int depth);
+// 3^exponent, exact up to exponent 39
+long long mengerPower3(int exponent);
+// the Menger digit rule on the 3^levels lattice: cell (i, j, k) is solid unless two of its base-3 digits of one level
+// are 1; cells outside the lattice are empty; the layer k = 0 is the Sierpinski carpet
+bool mengerSolidCell(long long i, long long j, long long k, int levels);
+
+// number of floats written per face in the given layout
+int mengerFaceFloats(FaceLayout layout);
+
+// element buffer of quadCount quads written with FACE_QUADS: quad q uses corners 4q + {0, 1, 2, 0, 2, 3};
+// with 16-bit indices quadCount must not exceed MENGER_QUADS_PER_CHUNK
+template<typename Index>
+void mengerQuadIndices(std::vector<Index>& indices, size_t quadCount)
+{
+    indices.resize(quadCount * MENGER_QUAD_INDICES);
+    Index* cursor = indices.data();
+    for (size_t quad = 0; quad < quadCount; quad++)
+    {
+        const Index first = (Index)(quad * MENGER_QUAD_VERTICES);
+        cursor[0] = first;
+        cursor[1] = (Index)(first + 1);
+        cursor[2] = (Index)(first + 2);
+        cursor[3] = first;
+        cursor[4] = (Index)(first + 2);
+        cursor[5] = (Index)(first + 3);
+        cursor += MENGER_QUAD_INDICES;
+    }
+}
+
+// writes the 36 vertices of a single cube at cursor and returns the cursor advanced past them
+float* writeBox(float* cursor, float x, float y, float z, float width);
+
+// writes cubes [firstCube, firstCube + cubeCount) of the sponge in the order of the recursive generator,
+// walking the base-20 cube index iteratively; returns the advanced cursor; stream: see emitCubes()
+float* mengerWriteRange(float* cursor, float xpos, float ypos, float zpos, float width, int depth,
+                        size_t firstCube, size_t cubeCount, FaceLayout layout = FACE_TRIANGLES, bool stream = false);
+
+// allocates the exact output size once and generates the whole sponge
+void mengerExact(VertexData& out, float xpos, float ypos, float zpos, float width, int depth);
+
+// same output as mengerExact(), generated by a pool of threads: the top-level sub-cubes (20, or 400 when there
+// are many threads) are handed out as tasks and every task writes its own precomputed slice of the buffer;
+// threadCount 0 uses all hardware threads; the generators below report to progress when it is given
+void mengerParallel(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                    unsigned int threadCount, FaceLayout layout = FACE_TRIANGLES, MengerProgress* progress = NULL);
+
+// number of faces on the surface of the sponge, faces shared by two touching cubes excluded:
+// 2 * 20^(depth-1) + 4 * 8^(depth-1)
+size_t mengerVisibleFaceCount(int depth);
+
+// writes the faces of a single cube selected by faceMask (bits: front, back, left, right, bottom, top),
+// with the same vertices as writeBox(), or as 4-corner quads; returns the advanced cursor
+float* writeBoxFaces(float* cursor, float x, float y, float z, float width, int faceMask,
+                     FaceLayout layout = FACE_TRIANGLES);
+
+// like mengerParallel(), but every cube emits only the faces that do not touch a neighbouring solid cube;
+// neighbours are looked up on the integer 3^(depth-1) lattice with the Menger digit rule
+void mengerVisibleFaces(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                        unsigned int threadCount, FaceLayout layout = FACE_TRIANGLES, MengerProgress* progress = NULL);
+
+// greedy meshing: the visible faces lying in one plane of the lattice are merged into maximal rectangles;
+// texture coordinates are given in lattice cells, so with GL_REPEAT every cube face still gets one texture tile
+void mengerGreedy(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                  unsigned int threadCount, FaceLayout layout = FACE_TRIANGLES, MengerProgress* progress = NULL);
+
+// the faces of mengerParallel() (visibleOnly false) or mengerVisibleFaces() (visibleOnly true) in the same order,
+// written as lattice corners; depth up to MENGER_COMPACT_MAX_DEPTH
+void mengerCompact(CompactVertexData& out, int depth, bool visibleOnly, unsigned int threadCount,
+                   FaceLayout layout = FACE_TRIANGLES, MengerProgress* progress = NULL);
+
+// instanced rendering data: one (x, y, z, width) record per cube, in the same order and with the same
+// values as the cubes of mengerExact(); the geometry itself is a single unit cube from writeBox()
+void mengerInstances(VertexData& out, float xpos, float ypos, float zpos, float width, int depth,
+                     unsigned int threadCount, MengerProgress* progress = NULL);
+
+// frustum culling over the cube hierarchy: the cubes are split into cells, the sub-trees cellLevels levels below the
+// whole sponge (20^cellLevels cells of consecutive cubes in the generation order)
+
+// planes (a, b, c, d) in sponge coordinates, a point is inside when a * x + b * y + c * z + d >= 0 for all six
+struct MengerFrustum
+{
+    float planes[6][4];
+};
+
+// cells [first, first + count)
+struct MengerCellRange
+{
+    size_t first, count;
+};
+
+struct MengerCullStats
+{
+    size_t visibleCells = 0, culledCells = 0;
+    size_t testedNodes = 0; // boxes tested against the frustum
+};
+
+// -1 when the box [x, x + width] x [y, y + width] x [z, z + width] is outside the frustum, 1 when it is entirely
+// inside, 0 when it crosses a plane (or is outside without being behind a single plane, counted as visible)
+int mengerClassifyBox(const MengerFrustum& frustum, float x, float y, float z, float width);
+
+// appends the ranges of cells inside or intersecting the frustum, adjacent ones merged; a sub-tree entirely
+// inside or outside is decided by one test of its box, without visiting its cells
+void mengerCull(std::vector<MengerCellRange>& ranges, MengerCullStats& stats, const MengerFrustum& frustum,
+                float xpos, float ypos, float zpos, float width, int cellLevels);
+
+// offsets[c]: faces written before cell c by mengerParallel() (visibleOnly false) or mengerVisibleFaces()
+// (visibleOnly true), and mengerCompact(); offsets has 20^cellLevels + 1 entries, the last one is the face count
+void mengerCellFaceOffsets(std::vector<size_t>& offsets, int depth, int cellLevels, bool visibleOnly,
+                           unsigned int threadCount);
+
+// hierarchical occupancy for voxel ray traversal, a 27-tree of the 3^(depth-1) lattice: every node is
+// MENGER_OCCUPANCY_NODE unsigned ints, the mask of its solid sub-cubes (bit x + 3 * y + 9 * z) followed by the offset
+// of the node of every sub-cube (MENGER_OCCUPANCY_EMPTY for empty ones and below the last level, whose bits are the
+// voxels); the root is at offset 0; identical sub-trees share one node, and as every solid sub-cube of the sponge is
+// the same smaller sponge, the tree is a chain of depth - 1 nodes; empty for depth 1, the solid cube
+const int MENGER_OCCUPANCY_NODE = 28;
+const unsigned int MENGER_OCCUPANCY_EMPTY = 0xffffffffu;
+void mengerOccupancy(std::vector<unsigned int>& nodes, int depth);
+
+// reference implementation kept for comparison: recursive, one push_back per float
+void calculateBox(std::vector<float>& vertices, float x, float y, float z, float width);
+void menger(std::vector<float>& vertices, float xpos, float ypos, float zpos, float width, int depth);
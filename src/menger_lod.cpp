@@ -0,0 +1,149 @@
+#include "menger_lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+MengerLod::MengerLod(float xpos, float ypos, float zpos, float width)
+    : leafCount(1), culled(0), deepest(1), done(false), changed(true), scale(0.0f), frustum(NULL)
+{
+    Node root = {xpos, ypos, zpos, width, 1, -1, false};
+    nodes.push_back(root);
+    eye[0] = eye[1] = eye[2] = 0.0f;
+    last.maxDepth = 0;
+    last.pixelError = 0.0f;
+    last.maxCubes = 0;
+    last.splitsPerUpdate = 0;
+    memset(&lastFrustum, 0, sizeof(lastFrustum));
+}
+
+// projected size of the holes of the node, measured from its point nearest to the eye
+float MengerLod::nodeError(const Node& node) const
+{
+    float half = node.width * 0.5f;
+    float dx = node.x + half - eye[0];
+    float dy = node.y + half - eye[1];
+    float dz = node.z + half - eye[2];
+    // half of the cube diagonal
+    float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - half * 1.7320508f;
+    distance = std::max(distance, 1e-4f);
+    return node.width / 3.0f * scale / distance;
+}
+
+// copy nodes[from] (already placed at scratch[to]) with the part of its subtree that is still needed
+void MengerLod::keepNode(size_t from, size_t to)
+{
+    const Node node = nodes[from];
+    bool outside = frustum != NULL && mengerClassifyBox(*frustum, node.x, node.y, node.z, node.width) < 0;
+    if (outside != node.culled)
+        changed = true;
+    scratch[to].culled = outside;
+    float error = nodeError(node);
+    bool refine = !outside && node.level < last.maxDepth && error > last.pixelError;
+
+    if (node.firstChild >= 0 && refine)
+    {
+        size_t first = scratch.size();
+        scratch.insert(scratch.end(), nodes.begin() + node.firstChild, nodes.begin() + node.firstChild + 20);
+        scratch[to].firstChild = (int)first;
+        leafCount += 19;
+        for (int child = 0; child < 20; child++)
+            keepNode(node.firstChild + child, first + child);
+        return;
+    }
+
+    scratch[to].firstChild = -1;
+    if (node.firstChild >= 0)
+        changed = true;
+    if (outside)
+        culled++;
+    if (refine)
+    {
+        Candidate candidate = {error, to};
+        candidates.push_back(candidate);
+    }
+    deepest = std::max(deepest, node.level);
+}
+
+// append the 20 sub-cubes of nodes[index], by the rule of menger()
+void MengerLod::split(size_t index)
+{
+    nodes[index].firstChild = (int)nodes.size();
+    const Node parent = nodes[index];
+    const float width = parent.width / 3.0f;
+    for (int ix = 0; ix < 3; ix++)
+    {
+        for (int iy = 0; iy < 3; iy++)
+        {
+            if ((ix == 1) && (iy == 1)) continue;
+            for (int iz = 0; iz < 3; iz++)
+            {
+                if ((iz == 1) && ((ix == 1) || (iy == 1))) continue;
+                Node child = {parent.x + width * ix, parent.y + width * iy, parent.z + width * iz, width, parent.level + 1,
+                              -1, false};
+                nodes.push_back(child);
+            }
+        }
+    }
+    leafCount += 19;
+    deepest = std::max(deepest, parent.level + 1);
+}
+
+bool MengerLod::update(float eyeX, float eyeY, float eyeZ, float pixelsPerUnit, const MengerFrustum* cullFrustum,
+                       const LodSettings& settings)
+{
+    bool moved = eyeX != eye[0] || eyeY != eye[1] || eyeZ != eye[2] || pixelsPerUnit != scale ||
+                 settings.maxDepth != last.maxDepth || settings.pixelError != last.pixelError ||
+                 settings.maxCubes != last.maxCubes || settings.splitsPerUpdate != last.splitsPerUpdate ||
+                 (cullFrustum != NULL) != (frustum != NULL) ||
+                 (cullFrustum != NULL && memcmp(cullFrustum, &lastFrustum, sizeof(lastFrustum)) != 0);
+    if (!moved && done)
+        return false;
+    if (cullFrustum != NULL)
+        lastFrustum = *cullFrustum;
+    frustum = cullFrustum != NULL ? &lastFrustum : NULL;
+    eye[0] = eyeX;
+    eye[1] = eyeY;
+    eye[2] = eyeZ;
+    scale = pixelsPerUnit;
+    last = settings;
+
+    // collapse: copy the tree, dropping the children of nodes that do not need them any more;
+    // the nodes that should be split are collected on the way
+    changed = leaves.empty();
+    scratch.clear();
+    candidates.clear();
+    scratch.push_back(nodes[0]);
+    leafCount = 1;
+    culled = 0;
+    deepest = 1;
+    keepNode(0, 0);
+    nodes.swap(scratch);
+
+    // refine: split the largest errors first, as many as the limits allow
+    size_t room = leafCount < settings.maxCubes ? (settings.maxCubes - leafCount) / 19 : 0;
+    size_t splits = std::min(std::min(candidates.size(), settings.splitsPerUpdate), room);
+    std::partial_sort(candidates.begin(), candidates.begin() + splits, candidates.end(),
+                      [](const Candidate& a, const Candidate& b) { return a.error > b.error; });
+    for (size_t i = 0; i < splits; i++)
+        split(candidates[i].node);
+    // the new children are only tested by the next update
+    done = splits == 0;
+    changed = changed || splits > 0;
+
+    if (changed)
+    {
+        leaves.clear();
+        leaves.reserve(leafCount * MENGER_INSTANCE_FLOATS);
+        for (const Node& node : nodes)
+        {
+            if (node.firstChild >= 0 || node.culled)
+                continue;
+            leaves.push_back(node.x);
+            leaves.push_back(node.y);
+            leaves.push_back(node.z);
+            leaves.push_back(node.width);
+        }
+    }
+    return changed;
+}
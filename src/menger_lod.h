@@ -0,0 +1,77 @@
+// Screen-space-error level of detail over the 20-ary sponge hierarchy
+// A node of the hierarchy is split into its 20 sub-cubes while the holes its solid cube would hide (a third of its
+// width) project to more than the allowed pixel error; every unsplit node is drawn as one solid cube. The cut is kept
+// between updates and only changed where the error moved across the threshold. Nodes outside the view frustum are
+// neither split nor drawn.
+
+#pragma once
+
+#include "menger.h"
+
+#include <cstddef>
+#include <vector>
+
+struct LodSettings
+{
+    int maxDepth;           // nodes of this level are never split, level 1 is the whole sponge
+    float pixelError;       // largest allowed projected size of the hidden holes, in pixels
+    size_t maxCubes;        // the cut never grows past this many cubes
+    size_t splitsPerUpdate; // nodes split by one update, the rest is refined by the following ones
+};
+
+class MengerLod
+{
+public:
+    MengerLod(float xpos, float ypos, float zpos, float width);
+
+    // refine and collapse the cut for a camera at (eyeX, eyeY, eyeZ) in sponge coordinates; pixelsPerUnit is the
+    // projected size in pixels of a unit length at distance 1; frustum (in sponge coordinates) may be NULL to keep
+    // the nodes out of view. Returns true when cubes() has changed
+    bool update(float eyeX, float eyeY, float eyeZ, float pixelsPerUnit, const MengerFrustum* frustum,
+                const LodSettings& settings);
+
+    // one (x, y, z, width) record per drawn cube, the instance format of mengerInstances()
+    const std::vector<float>& cubes() const { return leaves; }
+    size_t cubeCount() const { return leaves.size() / MENGER_INSTANCE_FLOATS; }
+    // leaves of the cut outside the frustum, not drawn
+    size_t culledCount() const { return culled; }
+    size_t nodeCount() const { return nodes.size(); }
+    int deepestLevel() const { return deepest; }
+    // nothing is left to split within the limits
+    bool converged() const { return done; }
+
+private:
+    struct Node
+    {
+        float x, y, z, width;
+        int level;
+        int firstChild; // index of the first of 20 consecutive children, -1 for a leaf of the cut
+        bool culled;    // leaf outside the frustum
+    };
+
+    struct Candidate
+    {
+        float error;
+        size_t node;
+    };
+
+    float nodeError(const Node& node) const;
+    void keepNode(size_t from, size_t to);
+    void split(size_t index);
+
+    std::vector<Node> nodes, scratch;
+    std::vector<Candidate> candidates;
+    std::vector<float> leaves;
+    size_t leafCount;
+    size_t culled;
+    int deepest;
+    bool done;
+    bool changed;
+
+    // camera and settings of the last update
+    float eye[3];
+    float scale;
+    LodSettings last;
+    const MengerFrustum* frustum;
+    MengerFrustum lastFrustum;
+};
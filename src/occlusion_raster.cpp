@@ -0,0 +1,348 @@
+#include "occlusion_raster.h"
+#include "menger.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2 1
+#include <emmintrin.h>
+#else
+#define OCCLUSION_SSE2 0
+#endif
+
+namespace
+{
+    // a box test is a few hundred nanoseconds, fewer boxes than this are not worth starting threads for
+    const size_t BOXES_PER_THREAD = 1024;
+    // occluder triangles smaller than a pixel are skipped (twice the area, as the edge functions give it)
+    const float MIN_OCCLUDER_AREA = 2.0f;
+    // the occluders are the sponge's own surface, so the nearest face of a box can lie in the plane of one; a box is
+    // hidden only by occluders nearer than it by this much, float rounding of coplanar depths never culls it
+    const float DEPTH_BIAS = 1e-5f;
+
+    // corner in pixels and depth, valid when it lies in front of the near plane
+    struct ScreenPoint
+    {
+        float x, y, z;
+        bool valid;
+    };
+
+    ScreenPoint project(const float* m, float x, float y, float z, int width, int height)
+    {
+        float clipX = m[0] * x + m[4] * y + m[8] * z + m[12];
+        float clipY = m[1] * x + m[5] * y + m[9] * z + m[13];
+        float clipZ = m[2] * x + m[6] * y + m[10] * z + m[14];
+        float clipW = m[3] * x + m[7] * y + m[11] * z + m[15];
+        ScreenPoint point;
+        point.valid = clipW > 1e-6f && clipZ >= -clipW;
+        if (!point.valid)
+        {
+            point.x = point.y = point.z = 0.0f;
+            return point;
+        }
+        float inverseW = 1.0f / clipW;
+        point.x = (clipX * inverseW * 0.5f + 0.5f) * width;
+        point.y = (clipY * inverseW * 0.5f + 0.5f) * height;
+        point.z = clipZ * inverseW;
+        return point;
+    }
+
+    // edge function A * x + B * y + C, positive on the inner side of the edge from a to b of a counter-clockwise
+    // triangle
+    struct Edge
+    {
+        float a, b, c;
+
+        Edge(const ScreenPoint& from, const ScreenPoint& to)
+        {
+            a = from.y - to.y;
+            b = to.x - from.x;
+            c = -(a * from.x + b * from.y);
+        }
+    };
+}
+
+OcclusionRaster::OcclusionRaster(int width, int height)
+    : bufferWidth(0), bufferHeight(0), tilesX(0), tilesY(0), useSimd(OCCLUSION_SSE2 != 0), triangles(0)
+{
+    resize(width, height);
+}
+
+void OcclusionRaster::resize(int width, int height)
+{
+    tilesX = (std::max(width, 0) + TILE_WIDTH - 1) / TILE_WIDTH;
+    tilesY = (std::max(height, 0) + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    bufferWidth = tilesX * TILE_WIDTH;
+    bufferHeight = tilesY * TILE_HEIGHT;
+    pixels.assign((size_t)bufferWidth * bufferHeight, FLT_MAX);
+    tileMax.assign((size_t)tilesX * tilesY, FLT_MAX);
+}
+
+void OcclusionRaster::setSimd(bool enabled)
+{
+    useSimd = enabled && OCCLUSION_SSE2;
+}
+
+void OcclusionRaster::clear()
+{
+    std::fill(pixels.begin(), pixels.end(), FLT_MAX);
+    std::fill(tileMax.begin(), tileMax.end(), FLT_MAX);
+    triangles = 0;
+}
+
+void OcclusionRaster::rasterizeQuads(const float* matrix, const float* quads, size_t quadCount)
+{
+    for (size_t quad = 0; quad < quadCount; quad++)
+    {
+        const float* corners = quads + quad * 12;
+        ScreenPoint points[4];
+        for (int corner = 0; corner < 4; corner++)
+            points[corner] = project(matrix, corners[corner * 3], corners[corner * 3 + 1], corners[corner * 3 + 2],
+                                     bufferWidth, bufferHeight);
+        if (points[0].valid && points[1].valid && points[2].valid)
+            rasterizeTriangle(&points[0].x, &points[1].x, &points[2].x);
+        if (points[0].valid && points[2].valid && points[3].valid)
+            rasterizeTriangle(&points[0].x, &points[2].x, &points[3].x);
+    }
+}
+
+// pixels whose centre is inside the triangle keep the nearer of their depth and the triangle's
+void OcclusionRaster::rasterizeTriangle(const float* first, const float* second, const float* third)
+{
+    ScreenPoint a = {first[0], first[1], first[2], true};
+    ScreenPoint b = {second[0], second[1], second[2], true};
+    ScreenPoint c = {third[0], third[1], third[2], true};
+    // twice the area in pixels; thin slivers cover next to nothing, but still cost the scan of their bounding box
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (std::abs(area) < MIN_OCCLUDER_AREA)
+        return;
+    if (area < 0.0f)
+    {
+        std::swap(b, c);
+        area = -area;
+    }
+
+    int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+    int maxX = std::min(bufferWidth - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x))));
+    int minY = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+    int maxY = std::min(bufferHeight - 1, (int)std::floor(std::max(a.y, std::max(b.y, c.y))));
+    if (minX > maxX || minY > maxY)
+        return;
+    triangles++;
+
+    // each edge is the barycentric weight of the opposite corner, so the depth is a plane over the screen too
+    const Edge bc(b, c), ca(c, a), ab(a, b);
+    const float inverseArea = 1.0f / area;
+    const float zA = (bc.a * a.z + ca.a * b.z + ab.a * c.z) * inverseArea;
+    const float zB = (bc.b * a.z + ca.b * b.z + ab.b * c.z) * inverseArea;
+    const float zC = (bc.c * a.z + ca.c * b.z + ab.c * c.z) * inverseArea;
+
+    // rows start at a multiple of 4, the buffer width is one too
+    const int firstX = minX & ~3;
+    for (int y = minY; y <= maxY; y++)
+    {
+        const float centerY = y + 0.5f;
+        const float rowBC = bc.b * centerY + bc.c;
+        const float rowCA = ca.b * centerY + ca.c;
+        const float rowAB = ab.b * centerY + ab.c;
+        const float rowZ = zB * centerY + zC;
+        float* row = pixels.data() + (size_t)y * bufferWidth;
+#if OCCLUSION_SSE2
+        if (useSimd)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 step = _mm_set1_ps(4.0f);
+            __m128 centerX = _mm_add_ps(_mm_set1_ps((float)firstX), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+            for (int x = firstX; x <= maxX; x += 4)
+            {
+                __m128 edgeBC = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(bc.a), centerX), _mm_set1_ps(rowBC));
+                __m128 edgeCA = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ca.a), centerX), _mm_set1_ps(rowCA));
+                __m128 edgeAB = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ab.a), centerX), _mm_set1_ps(rowAB));
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edgeBC, zero), _mm_cmpge_ps(edgeCA, zero)),
+                                           _mm_cmpge_ps(edgeAB, zero));
+                if (_mm_movemask_ps(inside) != 0)
+                {
+                    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), centerX), _mm_set1_ps(rowZ));
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+                centerX = _mm_add_ps(centerX, step);
+            }
+            continue;
+        }
+#endif
+        for (int x = firstX; x <= maxX; x++)
+        {
+            const float centerX = x + 0.5f;
+            if (bc.a * centerX + rowBC >= 0.0f && ca.a * centerX + rowCA >= 0.0f && ab.a * centerX + rowAB >= 0.0f)
+                row[x] = std::min(row[x], zA * centerX + rowZ);
+        }
+    }
+}
+
+void OcclusionRaster::finish()
+{
+    for (int tileY = 0; tileY < tilesY; tileY++)
+    {
+        for (int tileX = 0; tileX < tilesX; tileX++)
+        {
+            const float* tile = pixels.data() + (size_t)tileY * TILE_HEIGHT * bufferWidth + tileX * TILE_WIDTH;
+            float farthest = -FLT_MAX;
+#if OCCLUSION_SSE2
+            if (useSimd)
+            {
+                __m128 maximum = _mm_set1_ps(-FLT_MAX);
+                for (int y = 0; y < TILE_HEIGHT; y++)
+                    for (int x = 0; x < TILE_WIDTH; x += 4)
+                        maximum = _mm_max_ps(maximum, _mm_loadu_ps(tile + (size_t)y * bufferWidth + x));
+                maximum = _mm_max_ps(maximum, _mm_shuffle_ps(maximum, maximum, _MM_SHUFFLE(1, 0, 3, 2)));
+                maximum = _mm_max_ps(maximum, _mm_shuffle_ps(maximum, maximum, _MM_SHUFFLE(2, 3, 0, 1)));
+                farthest = _mm_cvtss_f32(maximum);
+            }
+            else
+#endif
+            {
+                for (int y = 0; y < TILE_HEIGHT; y++)
+                    for (int x = 0; x < TILE_WIDTH; x++)
+                        farthest = std::max(farthest, tile[(size_t)y * bufferWidth + x]);
+            }
+            tileMax[(size_t)tileY * tilesX + tileX] = farthest;
+        }
+    }
+}
+
+bool OcclusionRaster::testBox(const float* matrix, float x, float y, float z, float width) const
+{
+    // screen rectangle and nearest depth of the 8 corners
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        ScreenPoint point = project(matrix, x + (corner & 1 ? width : 0.0f), y + (corner & 2 ? width : 0.0f),
+                                    z + (corner & 4 ? width : 0.0f), bufferWidth, bufferHeight);
+        // a box reaching behind the camera is not tested
+        if (!point.valid)
+            return true;
+        minX = std::min(minX, point.x);
+        maxX = std::max(maxX, point.x);
+        minY = std::min(minY, point.y);
+        maxY = std::max(maxY, point.y);
+        nearest = std::min(nearest, point.z);
+    }
+
+    // every pixel the rectangle touches, not only those with the centre inside
+    const int x0 = std::max(0, (int)std::floor(minX));
+    const int x1 = std::min(bufferWidth - 1, (int)std::floor(maxX));
+    const int y0 = std::max(0, (int)std::floor(minY));
+    const int y1 = std::min(bufferHeight - 1, (int)std::floor(maxY));
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    const float limit = nearest - DEPTH_BIAS;
+    for (int tileY = y0 / TILE_HEIGHT; tileY <= y1 / TILE_HEIGHT; tileY++)
+    {
+        for (int tileX = x0 / TILE_WIDTH; tileX <= x1 / TILE_WIDTH; tileX++)
+        {
+            // every occluder of the tile is nearer than the box
+            if (tileMax[(size_t)tileY * tilesX + tileX] < limit)
+                continue;
+
+            const int fromX = std::max(x0, tileX * TILE_WIDTH), toX = std::min(x1, tileX * TILE_WIDTH + TILE_WIDTH - 1);
+            const int fromY = std::max(y0, tileY * TILE_HEIGHT), toY = std::min(y1, tileY * TILE_HEIGHT + TILE_HEIGHT - 1);
+            for (int py = fromY; py <= toY; py++)
+            {
+                const float* row = pixels.data() + (size_t)py * bufferWidth;
+#if OCCLUSION_SSE2
+                if (useSimd)
+                {
+                    // lanes outside [fromX, toX] are masked off
+                    const __m128i first = _mm_set1_epi32(fromX), last = _mm_set1_epi32(toX);
+                    const __m128 depth = _mm_set1_ps(limit);
+                    for (int px = tileX * TILE_WIDTH; px <= toX; px += 4)
+                    {
+                        __m128i lanes = _mm_add_epi32(_mm_set1_epi32(px), _mm_set_epi32(3, 2, 1, 0));
+                        __m128i outside = _mm_or_si128(_mm_cmplt_epi32(lanes, first), _mm_cmpgt_epi32(lanes, last));
+                        __m128 farther = _mm_cmpge_ps(_mm_loadu_ps(row + px), depth);
+                        if (_mm_movemask_ps(_mm_andnot_ps(_mm_castsi128_ps(outside), farther)) != 0)
+                            return true;
+                    }
+                    continue;
+                }
+#endif
+                for (int px = fromX; px <= toX; px++)
+                    if (row[px] >= limit)
+                        return true;
+            }
+        }
+    }
+    return false;
+}
+
+void OcclusionRaster::cullBoxes(const float* matrix, const float* boxes, size_t count, std::vector<char>& visible,
+                                unsigned int threadCount) const
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = (unsigned int)std::max<size_t>(1, std::min<size_t>(threadCount, count / BOXES_PER_THREAD));
+
+    auto test = [&](size_t begin, size_t end)
+    {
+        for (size_t n = begin; n < end; n++)
+        {
+            const float* box = boxes + n * MENGER_INSTANCE_FLOATS;
+            if (visible[n] && !testBox(matrix, box[0], box[1], box[2], box[3]))
+                visible[n] = 0;
+        }
+    };
+    if (threadCount == 1)
+    {
+        test(0, count);
+        return;
+    }
+
+    // the buffer is only read, every thread writes its own slice of visible
+    std::vector<std::thread> threads;
+    for (unsigned int thread = 0; thread < threadCount; thread++)
+        threads.push_back(std::thread(test, count * thread / threadCount, count * (thread + 1) / threadCount));
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void mengerOccluders(std::vector<float>& quads, float xpos, float ypos, float zpos, float width, int depth,
+                     size_t maxQuads, unsigned int threadCount)
+{
+    VertexData greedy;
+    mengerGreedy(greedy, xpos, ypos, zpos, width, depth, threadCount, FACE_QUADS);
+    const size_t count = greedy.vertexCount() / MENGER_QUAD_VERTICES;
+
+    // corners 0, 1, 3 of a quad span both of its sides
+    std::vector<std::pair<float, size_t> > areas(count);
+    for (size_t quad = 0; quad < count; quad++)
+    {
+        const float* corner = greedy.data + quad * MENGER_QUAD_FLOATS;
+        float sides[2] = {0.0f, 0.0f};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float along = corner[MENGER_VERTEX_FLOATS + axis] - corner[axis];
+            float across = corner[3 * MENGER_VERTEX_FLOATS + axis] - corner[axis];
+            sides[0] += along * along;
+            sides[1] += across * across;
+        }
+        areas[quad] = std::make_pair(sides[0] * sides[1], quad);
+    }
+    const size_t kept = std::min(maxQuads, count);
+    std::nth_element(areas.begin(), areas.begin() + kept, areas.end(), std::greater<std::pair<float, size_t> >());
+
+    quads.resize(kept * 12);
+    for (size_t n = 0; n < kept; n++)
+    {
+        const float* corner = greedy.data + areas[n].second * MENGER_QUAD_FLOATS;
+        for (int c = 0; c < 4; c++)
+            for (int axis = 0; axis < 3; axis++)
+                quads[n * 12 + c * 3 + axis] = corner[c * MENGER_VERTEX_FLOATS + axis];
+    }
+}
@@ -0,0 +1,62 @@
+// Software occlusion culling
+// The largest solid faces of the sponge are rasterized on the CPU into a small depth buffer, four pixels at a time
+// with SSE2, and the boxes of the cells are tested against it before anything is submitted to the GPU. Depth is z / w
+// of normalized device coordinates, smaller is nearer. The buffer keeps the nearest occluder of every pixel, and every
+// tile of TILE_WIDTH x TILE_HEIGHT pixels the farthest of them, so that a box behind a whole tile is rejected without
+// reading its pixels.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class OcclusionRaster
+{
+public:
+    static const int TILE_WIDTH = 8;
+    static const int TILE_HEIGHT = 8;
+
+    // the size is rounded up to whole tiles
+    OcclusionRaster(int width = 0, int height = 0);
+    void resize(int width, int height);
+    int width() const { return bufferWidth; }
+    int height() const { return bufferHeight; }
+
+    // SSE2 when the compiler targets it, set to false to compare with the scalar loops
+    void setSimd(bool enabled);
+    bool simd() const { return useSimd; }
+
+    // every pixel back at the far plane
+    void clear();
+    // quads of 4 corners (x, y, z) in the coordinates transformed by matrix (column-major 4x4, as glm stores it);
+    // triangles reaching behind the near plane are skipped, which only ever leaves more visible
+    void rasterizeQuads(const float* matrix, const float* quads, size_t quadCount);
+    // farthest depth of every tile, to be called after the occluders and before the tests
+    void finish();
+
+    // true when some part of the box [x, x + width] x [y, y + width] x [z, z + width] may be visible
+    bool testBox(const float* matrix, float x, float y, float z, float width) const;
+    // boxes of (x, y, z, width) records; visible[n] of a box that is entirely hidden is cleared, boxes with visible[n]
+    // already 0 are skipped; the boxes are split between threadCount threads (0 - all hardware threads)
+    void cullBoxes(const float* matrix, const float* boxes, size_t count, std::vector<char>& visible,
+                   unsigned int threadCount) const;
+
+    size_t rasterizedTriangles() const { return triangles; }
+    const std::vector<float>& depth() const { return pixels; }
+
+private:
+    void rasterizeTriangle(const float* a, const float* b, const float* c);
+
+    int bufferWidth, bufferHeight;
+    int tilesX, tilesY;
+    bool useSimd;
+    std::vector<float> pixels; // row-major, bufferWidth x bufferHeight
+    std::vector<float> tileMax;
+    size_t triangles;
+};
+
+// the occluders of a sponge of the given depth: the largest of its greedy rectangles (mengerGreedy()), at most
+// maxQuads of them, as 4 corners (x, y, z) each; every rectangle is a solid part of the surface, so whatever it hides
+// is hidden by the sponge as well
+void mengerOccluders(std::vector<float>& quads, float xpos, float ypos, float zpos, float width, int depth,
+                     size_t maxQuads, unsigned int threadCount);
@@ -0,0 +1,9 @@
+// Memory used by the process, for the memory panel
+// Read from the operating system on every call; 0 where it is not supported.
+
+#pragma once
+
+#include <cstddef>
+
+// resident set size: bytes of the process currently held in physical memory
+size_t processResidentBytes();
@@ -0,0 +1,824 @@
+#include "sponge_cache.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+std::list<CachedSponge> sponge_cache;
+int cache_budget_mb = 512;
+bool precompute_neighbours = true;
+float upload_budget_ms = 2.0f;
+bool zero_copy = true;
+bool has_buffer_storage = false;
+bool has_compute_shaders = false;
+int max_compute_depth = 0;
+std::vector<MappedBuffer> retired_buffers;
+GenerationJob regeneration;
+GenerationJob precompute;
+std::list<GenerationJob> stale_jobs;
+bool shown_from_cache = false;
+double generation_ms = 0.0;
+int generation_threads = 0;
+size_t resident_bytes = 0;
+size_t regeneration_peak_bytes = 0;
+
+namespace
+{
+    const size_t MAX_RETIRED_BUFFERS = 4;
+
+    // copy size bytes to offset of the buffer through GL_COPY_WRITE_BUFFER, which leaves the VAO bindings alone;
+    // the range is not read by any draw yet, so it is mapped unsynchronized and the driver does not wait for the GPU
+    void writeBufferRange(unsigned int buffer, size_t offset, size_t size, const void* source)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (target != NULL)
+        {
+            memcpy(target, source, size);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        else
+        {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, source);
+        }
+    }
+
+    // lattice corner and texture coordinates of CompactVertex
+    void setCompactVertexAttributes()
+    {
+        // unsigned shorts converted to float as they are, without normalization
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(CompactVertex),
+                              (void*)offsetof(CompactVertex, x));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex),
+                              (void*)offsetof(CompactVertex, u));
+        glEnableVertexAttribArray(2);
+    }
+
+    // allocate the bound GL_ARRAY_BUFFER for the generated vertices in their format and describe it to the bound VAO;
+    // the vertices themselves are sent by streamSponge(), or are already in it when it is the mapped buffer
+    void fillSpongeVertices(SpongeBuffers& buffers, const SpongeGeometry& geometry)
+    {
+        buffers.compact = geometry.compactVertices.size > 0;
+        if (buffers.compact)
+        {
+            buffers.vertexCount = geometry.compactVertices.size;
+            buffers.vertexBytes = buffers.vertexCount * sizeof(CompactVertex);
+            if (buffers.mapped.buffer == 0)
+                glBufferData(GL_ARRAY_BUFFER, buffers.vertexBytes, NULL, GL_STATIC_DRAW);
+            setCompactVertexAttributes();
+        }
+        else
+        {
+            buffers.vertexCount = geometry.vertices.vertexCount();
+            buffers.vertexBytes = geometry.vertices.size * sizeof(float);
+            if (buffers.mapped.buffer == 0)
+                glBufferData(GL_ARRAY_BUFFER, buffers.vertexBytes, NULL, GL_STATIC_DRAW);
+            setVertexAttributes();
+        }
+    }
+
+    // fill Vertex Buffer
+    void fillVertexBuffer(SpongeBuffers& buffers, const SpongeGeometry& geometry)
+    {
+        // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
+        glBindVertexArray(buffers.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+
+        // fill with vertex data
+        fillSpongeVertices(buffers, geometry);
+    }
+
+    // fill the quad vertices and the element buffer, which is part of the VAO state
+    void fillIndexedBuffer(SpongeBuffers& buffers, const SpongeGeometry& geometry)
+    {
+        fillVertexBuffer(buffers, geometry);
+
+        glGenBuffers(1, &buffers.EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+        buffers.indices32 = !geometry.meshIndices.empty();
+        if (buffers.indices32)
+        {
+            buffers.indexCount = geometry.meshIndices.size();
+            buffers.indexBytes = buffers.indexCount * sizeof(unsigned int);
+            // streamed together with the vertices they refer to, at once when the vertices need no upload
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBytes,
+                         buffers.mapped.buffer != 0 ? geometry.meshIndices.data() : NULL, GL_STATIC_DRAW);
+        }
+        else
+        {
+            buffers.indexCount = geometry.chunkIndices.size();
+            buffers.indexBytes = buffers.indexCount * sizeof(unsigned short);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBytes, geometry.chunkIndices.data(),
+                         GL_STATIC_DRAW);
+        }
+    }
+}
+
+// deepest level selectable in the render mode: CPU generated sponges are limited by their memory
+int maxDepthOf(int renderMode)
+{
+    if (renderMode == RENDER_PROCEDURAL)
+        return MAX_PROCEDURAL_DEPTH;
+    if (renderMode == RENDER_LOD)
+        return MAX_LOD_DEPTH;
+    if (renderMode == RENDER_RAYMARCH)
+        return MAX_RAYMARCH_DEPTH;
+    if (renderMode == RENDER_VOXEL)
+        return MAX_VOXEL_DEPTH;
+    if (renderMode == RENDER_COMPUTE && has_compute_shaders)
+        return max_compute_depth;
+    return MAX_GENERATED_DEPTH;
+}
+
+// the render mode draws a sponge generated on the CPU and cached in buffers; RENDER_COMPUTE when it falls back to the
+// CPU generator
+bool generatesGeometry(int renderMode)
+{
+    if (renderMode == RENDER_COMPUTE)
+        return !has_compute_shaders;
+    return renderMode != RENDER_PROCEDURAL && renderMode != RENDER_LOD && renderMode != RENDER_RAYMARCH &&
+           renderMode != RENDER_VOXEL && renderMode != RENDER_CARPET && renderMode != RENDER_FLY;
+}
+
+// levels of the cells of frustum culling for a sponge of the depth
+int cullCellLevels(int depth)
+{
+    return std::min(depth - 1, CULL_CELL_LEVELS);
+}
+
+// generate the sponge of the key, every buffer is allocated once with its exact size and filled by threadCount
+// worker threads; renderMode and geometryMode select what is generated
+void generateSponge(SpongeGeometry& out, const SpongeKey& key, unsigned int threadCount, MengerProgress* progress)
+{
+    double start = glfwGetTime();
+    // RENDER_PROCEDURAL has nothing to generate
+    if (key.renderMode == RENDER_INSTANCED)
+    {
+        mengerInstances(out.instances, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, key.depth, threadCount, progress);
+    }
+    else if (key.renderMode == RENDER_VERTICES || key.renderMode == RENDER_INDEXED)
+    {
+        FaceLayout layout = key.renderMode == RENDER_INDEXED ? FACE_QUADS : FACE_TRIANGLES;
+        if (key.compact)
+            mengerCompact(out.compactVertices, key.depth, key.geometryMode == GEOMETRY_VISIBLE_FACES, threadCount, layout,
+                          progress);
+        else if (key.geometryMode == GEOMETRY_GREEDY)
+            mengerGreedy(out.vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, key.depth, threadCount, layout, progress);
+        else if (key.geometryMode == GEOMETRY_VISIBLE_FACES)
+            mengerVisibleFaces(out.vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, key.depth, threadCount, layout,
+                               progress);
+        else
+            mengerParallel(out.vertices, SPONGE_X, SPONGE_Y, SPONGE_Z, SPONGE_WIDTH, key.depth, threadCount, layout, progress);
+    }
+    if ((key.renderMode == RENDER_VERTICES || key.renderMode == RENDER_INDEXED) && key.geometryMode != GEOMETRY_GREEDY &&
+        !(progress != NULL && progress->cancelled))
+        mengerCellFaceOffsets(out.cellFaces, key.depth, cullCellLevels(key.depth),
+                              key.geometryMode == GEOMETRY_VISIBLE_FACES, threadCount);
+    if (key.renderMode == RENDER_INDEXED && !(progress != NULL && progress->cancelled))
+    {
+        size_t quads = (key.compact ? out.compactVertices.size : out.vertices.vertexCount()) / MENGER_QUAD_VERTICES;
+        if (key.indices32)
+            mengerQuadIndices(out.meshIndices, quads);
+        else
+            mengerQuadIndices(out.chunkIndices, std::min(quads, (size_t)MENGER_QUADS_PER_CHUNK));
+    }
+    out.generationMs = (glfwGetTime() - start) * 1000.0;
+}
+
+// upper bound of the GPU memory taken by the sponge of the key, known before generating it
+// (greedy meshes are counted as the visible faces they are merged from)
+size_t estimateSpongeBytes(const SpongeKey& key)
+{
+    const size_t cubes = mengerCubeCount(key.depth);
+    if (key.renderMode == RENDER_INSTANCED)
+        return (cubes * MENGER_INSTANCE_FLOATS + MENGER_CUBE_FLOATS) * sizeof(float);
+    if (key.renderMode == RENDER_PROCEDURAL)
+        return 0;
+
+    size_t faces = key.geometryMode == GEOMETRY_FULL ? cubes * 6 : mengerVisibleFaceCount(key.depth);
+    size_t vertexBytes = key.compact ? sizeof(CompactVertex) : MENGER_VERTEX_FLOATS * sizeof(float);
+    if (key.renderMode == RENDER_VERTICES)
+        return faces * 6 * vertexBytes;
+
+    size_t indexBytes = key.indices32 ? faces * MENGER_QUAD_INDICES * sizeof(unsigned int)
+                                      : std::min(faces, (size_t)MENGER_QUADS_PER_CHUNK) * MENGER_QUAD_INDICES * sizeof(unsigned short);
+    return faces * MENGER_QUAD_VERTICES * vertexBytes + indexBytes;
+}
+
+// exact size of the vertex (instance) data of the key, 0 when it is only known after generation
+size_t spongeStreamBytes(const SpongeKey& key)
+{
+    const size_t cubes = mengerCubeCount(key.depth);
+    if (key.renderMode == RENDER_INSTANCED)
+        return cubes * MENGER_INSTANCE_FLOATS * sizeof(float);
+    if (key.renderMode == RENDER_PROCEDURAL || key.geometryMode == GEOMETRY_GREEDY)
+        return 0;
+
+    size_t faces = key.geometryMode == GEOMETRY_FULL ? cubes * 6 : mengerVisibleFaceCount(key.depth);
+    size_t vertexBytes = key.compact ? sizeof(CompactVertex) : MENGER_VERTEX_FLOATS * sizeof(float);
+    return faces * (key.renderMode == RENDER_INDEXED ? MENGER_QUAD_VERTICES : 6) * vertexBytes;
+}
+
+// CPU memory held by the generated geometry
+size_t geometryBytes(const SpongeGeometry& geometry)
+{
+    // vertices written into a mapped buffer are GPU memory
+    size_t bytes = geometry.vertices.inTarget() ? 0 : geometry.vertices.size * sizeof(float);
+    if (!geometry.compactVertices.inTarget())
+        bytes += geometry.compactVertices.size * sizeof(CompactVertex);
+    if (!geometry.instances.inTarget())
+        bytes += geometry.instances.size * sizeof(float);
+    return bytes + geometry.chunkIndices.size() * sizeof(unsigned short) + geometry.meshIndices.size() * sizeof(unsigned int);
+}
+
+// a mapped buffer of exactly bytes for a generator to write into: a retired one the GPU is done with, or a new one;
+// an empty MappedBuffer when mapping fails
+MappedBuffer acquireMappedBuffer(size_t bytes)
+{
+    for (std::vector<MappedBuffer>::iterator it = retired_buffers.begin(); it != retired_buffers.end(); ++it)
+    {
+        if (it->bytes != bytes)
+            continue;
+        GLenum status = glClientWaitSync(it->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+
+        MappedBuffer buffer = *it;
+        retired_buffers.erase(it);
+        glDeleteSync(buffer.fence);
+        buffer.fence = 0;
+        if (!buffer.persistent)
+        {
+            // the fence has passed, nothing reads the old contents any more
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.buffer);
+            buffer.pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        if (buffer.pointer != NULL)
+            return buffer;
+        glDeleteBuffers(1, &buffer.buffer);
+        return MappedBuffer();
+    }
+
+    MappedBuffer buffer;
+    buffer.bytes = bytes;
+    glGenBuffers(1, &buffer.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.buffer);
+    if (has_buffer_storage)
+    {
+        // coherent: the writes of the generator threads are visible to the GPU without flushing
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, NULL, flags);
+        buffer.pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, flags);
+        buffer.persistent = true;
+    }
+    else
+    {
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        buffer.pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (buffer.pointer == NULL)
+    {
+        glDeleteBuffers(1, &buffer.buffer);
+        return MappedBuffer();
+    }
+    return buffer;
+}
+
+// the buffer is no longer drawn or written: it is fenced behind the frames already submitted and kept for reuse
+void retireMappedBuffer(MappedBuffer buffer)
+{
+    if (buffer.buffer == 0)
+        return;
+    if (!buffer.persistent && buffer.pointer != NULL)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer.pointer = NULL;
+    }
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    retired_buffers.push_back(buffer);
+
+    if (retired_buffers.size() > MAX_RETIRED_BUFFERS)
+    {
+        glDeleteSync(retired_buffers.front().fence);
+        glDeleteBuffers(1, &retired_buffers.front().buffer);
+        retired_buffers.erase(retired_buffers.begin());
+    }
+}
+
+// position and texture coordinates of the interleaved sponge vertices, read from the bound GL_ARRAY_BUFFER
+void setVertexAttributes()
+{
+    // position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, MENGER_VERTEX_FLOATS * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // texture coord attribute
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, MENGER_VERTEX_FLOATS * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+}
+
+// fill the unit cube and the per-instance (x, y, z, width) buffer
+void fillInstanceBuffer(SpongeBuffers& buffers, const SpongeGeometry& geometry)
+{
+    glBindVertexArray(buffers.VAO);
+
+    float cube[MENGER_CUBE_FLOATS];
+    writeBox(cube, 0.0f, 0.0f, 0.0f, 1.0f);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+    setVertexAttributes();
+
+    // instance attribute, advanced once per drawn cube
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.instanceVBO);
+    if (buffers.mapped.buffer == 0)
+        glBufferData(GL_ARRAY_BUFFER, geometry.instances.size * sizeof(float), NULL, GL_STATIC_DRAW);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, MENGER_INSTANCE_FLOATS * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    buffers.vertexCount = MENGER_CUBE_VERTICES;
+    buffers.instanceCount = geometry.instances.size / MENGER_INSTANCE_FLOATS;
+    buffers.vertexBytes = sizeof(cube) + geometry.instances.size * sizeof(float);
+}
+
+// create the GL objects of a sponge and allocate its buffers, the geometry is sent by streamSponge();
+// a mapped buffer set in buffers.mapped already holds the vertices (instances) and is used as it is
+void uploadSponge(SpongeBuffers& buffers, const SpongeKey& key, const SpongeGeometry& geometry)
+{
+    glGenVertexArrays(1, &buffers.VAO);
+    buffers.renderMode = key.renderMode;
+    buffers.generationMs = geometry.generationMs;
+
+    if (key.renderMode == RENDER_INSTANCED)
+    {
+        glGenBuffers(1, &buffers.VBO);
+        buffers.instanceVBO = buffers.mapped.buffer;
+        if (buffers.instanceVBO == 0)
+            glGenBuffers(1, &buffers.instanceVBO);
+        fillInstanceBuffer(buffers, geometry);
+    }
+    else
+    {
+        buffers.VBO = buffers.mapped.buffer;
+        if (buffers.VBO == 0)
+            glGenBuffers(1, &buffers.VBO);
+        if (key.renderMode == RENDER_INDEXED)
+            fillIndexedBuffer(buffers, geometry);
+        else
+            fillVertexBuffer(buffers, geometry);
+    }
+
+    if (buffers.mapped.buffer != 0)
+        buffers.readyCount = key.renderMode == RENDER_INSTANCED ? buffers.instanceCount : buffers.vertexCount;
+
+    buffers.cullCellLevels = cullCellLevels(key.depth);
+    buffers.cellFaces = geometry.cellFaces;
+    if (key.renderMode == RENDER_INSTANCED)
+        buffers.cellCount = mengerCubeCount(buffers.cullCellLevels + 1);
+    else if (!geometry.cellFaces.empty())
+        buffers.cellCount = geometry.cellFaces.size() - 1;
+}
+
+// send the next chunks of the geometry until all of it is on the GPU (returns true) or glfwGetTime() passes
+// the deadline; at least one chunk is sent per call. Chunks end on whole faces (whole quads with their indices),
+// so drawSponge() can draw everything before readyCount
+bool streamSponge(SpongeBuffers& buffers, const SpongeGeometry& geometry, double deadline)
+{
+    const size_t chunkBytes = 1024 * 1024;
+
+    unsigned int buffer = buffers.VBO;
+    const char* source = (const char*)geometry.vertices.data;
+    size_t elementBytes = MENGER_VERTEX_FLOATS * sizeof(float);
+    size_t total = buffers.vertexCount;
+    size_t granule = 6; // vertices of one face of FACE_TRIANGLES
+    if (buffers.renderMode == RENDER_INSTANCED)
+    {
+        buffer = buffers.instanceVBO;
+        source = (const char*)geometry.instances.data;
+        elementBytes = MENGER_INSTANCE_FLOATS * sizeof(float);
+        total = buffers.instanceCount;
+        granule = 1;
+    }
+    else if (buffers.compact)
+    {
+        source = (const char*)geometry.compactVertices.data;
+        elementBytes = sizeof(CompactVertex);
+    }
+    if (buffers.renderMode == RENDER_INDEXED)
+        granule = MENGER_QUAD_VERTICES;
+    const size_t chunk = std::max((size_t)1, chunkBytes / (elementBytes * granule)) * granule;
+
+    do
+    {
+        if (buffers.readyCount >= total)
+            break;
+        size_t first = buffers.readyCount;
+        size_t count = std::min(chunk, total - first);
+        writeBufferRange(buffer, first * elementBytes, count * elementBytes, source + first * elementBytes);
+        if (buffers.indices32)
+        {
+            size_t firstIndex = first / MENGER_QUAD_VERTICES * MENGER_QUAD_INDICES;
+            writeBufferRange(buffers.EBO, firstIndex * sizeof(unsigned int),
+                             count / MENGER_QUAD_VERTICES * MENGER_QUAD_INDICES * sizeof(unsigned int),
+                             geometry.meshIndices.data() + firstIndex);
+        }
+        buffers.readyCount = first + count;
+    }
+    while (glfwGetTime() < deadline);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffers.readyCount >= total;
+}
+
+// called once per frame on the GL thread: sends upload_budget_ms worth of pending geometry, the shown sponge first;
+// a finished upload drops its CPU copy
+void streamUploads()
+{
+    const double deadline = glfwGetTime() + upload_budget_ms / 1000.0;
+    for (CachedSponge& cached : sponge_cache)
+    {
+        if (!cached.staging)
+            continue;
+        if (streamSponge(cached.buffers, *cached.staging, deadline))
+            cached.staging.reset();
+        if (glfwGetTime() >= deadline)
+            return;
+    }
+}
+
+void deleteSpongeBuffers(SpongeBuffers& buffers)
+{
+    if (buffers.mapped.buffer != 0)
+    {
+        // kept for reuse instead of being deleted below
+        if (buffers.VBO == buffers.mapped.buffer)
+            buffers.VBO = 0;
+        else
+            buffers.instanceVBO = 0;
+        retireMappedBuffer(buffers.mapped);
+    }
+    glDeleteVertexArrays(1, &buffers.VAO);
+    glDeleteBuffers(1, &buffers.VBO);
+    glDeleteBuffers(1, &buffers.instanceVBO);
+    glDeleteBuffers(1, &buffers.EBO);
+    buffers = SpongeBuffers();
+}
+
+// draw the cells of ranges (the whole sponge when ranges is NULL or the sponge has no cells), as much of them as has
+// been uploaded so far; returns the number of drawn triangles
+size_t drawSponge(const SpongeBuffers& buffers, const std::vector<MengerCellRange>* ranges)
+{
+    // ranges of elements: vertices, quads of RENDER_INDEXED or instances
+    static std::vector<size_t> firsts, counts;
+    firsts.clear();
+    counts.clear();
+    const bool indexed = buffers.renderMode == RENDER_INDEXED;
+    const bool instanced = buffers.renderMode == RENDER_INSTANCED;
+    const size_t ready = indexed ? buffers.readyCount / MENGER_QUAD_VERTICES : buffers.readyCount;
+    if (ranges == NULL || buffers.cellCount == 0)
+    {
+        firsts.push_back(0);
+        counts.push_back(ready);
+    }
+    else
+    {
+        for (const MengerCellRange& range : *ranges)
+        {
+            size_t first, end;
+            if (instanced)
+            {
+                size_t cubesPerCell = buffers.instanceCount / buffers.cellCount;
+                first = range.first * cubesPerCell;
+                end = (range.first + range.count) * cubesPerCell;
+            }
+            else
+            {
+                size_t elementsPerFace = indexed ? 1 : 6;
+                first = buffers.cellFaces[range.first] * elementsPerFace;
+                end = buffers.cellFaces[range.first + range.count] * elementsPerFace;
+            }
+            end = std::min(end, ready);
+            if (first < end)
+            {
+                firsts.push_back(first);
+                counts.push_back(end - first);
+            }
+        }
+    }
+
+    glBindVertexArray(buffers.VAO);
+    size_t triangles = 0;
+    if (instanced)
+    {
+        // the instance attribute is pointed at the first cube of every range
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.instanceVBO);
+        for (size_t n = 0; n < firsts.size(); n++)
+        {
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, MENGER_INSTANCE_FLOATS * sizeof(float),
+                                  (void*)(firsts[n] * MENGER_INSTANCE_FLOATS * sizeof(float)));
+            glDrawArraysInstanced(GL_TRIANGLES, 0, MENGER_CUBE_VERTICES, (GLsizei)counts[n]);
+            triangles += counts[n] * 12;
+        }
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, MENGER_INSTANCE_FLOATS * sizeof(float), (void*)0);
+    }
+    else if (indexed)
+    {
+        static std::vector<GLsizei> indexCounts;
+        static std::vector<const void*> indexOffsets;
+        static std::vector<GLint> baseVertices;
+        indexCounts.clear();
+        indexOffsets.clear();
+        baseVertices.clear();
+        for (size_t n = 0; n < firsts.size(); n++)
+        {
+            triangles += counts[n] * 2;
+            if (buffers.indices32)
+            {
+                indexCounts.push_back((GLsizei)(counts[n] * MENGER_QUAD_INDICES));
+                indexOffsets.push_back((const void*)(firsts[n] * MENGER_QUAD_INDICES * sizeof(unsigned int)));
+                continue;
+            }
+
+            // the 16-bit pattern covers one chunk, the base vertex moves it over the following ones,
+            // so a range is drawn in pieces that do not cross a chunk boundary
+            for (size_t quad = firsts[n], end = firsts[n] + counts[n]; quad < end;)
+            {
+                size_t chunk = quad / MENGER_QUADS_PER_CHUNK * MENGER_QUADS_PER_CHUNK;
+                size_t pieceEnd = std::min(end, chunk + MENGER_QUADS_PER_CHUNK);
+                indexCounts.push_back((GLsizei)((pieceEnd - quad) * MENGER_QUAD_INDICES));
+                indexOffsets.push_back((const void*)((quad - chunk) * MENGER_QUAD_INDICES * sizeof(unsigned short)));
+                baseVertices.push_back((GLint)(chunk * MENGER_QUAD_VERTICES));
+                quad = pieceEnd;
+            }
+        }
+        if (buffers.indices32)
+            glMultiDrawElements(GL_TRIANGLES, indexCounts.data(), GL_UNSIGNED_INT, indexOffsets.data(),
+                                (GLsizei)indexCounts.size());
+        else
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, indexCounts.data(), GL_UNSIGNED_SHORT, indexOffsets.data(),
+                                          (GLsizei)indexCounts.size(), baseVertices.data());
+    }
+    else
+    {
+        static std::vector<GLint> vertexFirsts;
+        static std::vector<GLsizei> vertexCounts;
+        vertexFirsts.assign(firsts.begin(), firsts.end());
+        vertexCounts.assign(counts.begin(), counts.end());
+        glMultiDrawArrays(GL_TRIANGLES, vertexFirsts.data(), vertexCounts.data(), (GLsizei)vertexFirsts.size());
+        for (size_t count : counts)
+            triangles += count / 3;
+    }
+    return triangles;
+}
+
+// the sponge to draw from the non-empty cache: the shown one, or while it is still being uploaded the most recently
+// shown one that was drawn whole, so a new sponge replaces the old one at once instead of filling in over a few frames;
+// only a first sponge of its render mode is drawn partially
+const CachedSponge& drawnSponge()
+{
+    CachedSponge& shown = sponge_cache.front();
+    if (!shown.staging)
+    {
+        shown.drawn = true;
+        return shown;
+    }
+    for (const CachedSponge& cached : sponge_cache)
+    {
+        if (cached.drawn && !cached.staging && cached.key.renderMode == shown.key.renderMode)
+            return cached;
+    }
+    return shown;
+}
+
+// cached sponge of the key or NULL; does not change the order of the cache
+SpongeBuffers* findCachedSponge(const SpongeKey& key)
+{
+    for (CachedSponge& cached : sponge_cache)
+    {
+        if (cached.key == key)
+            return &cached.buffers;
+    }
+    return NULL;
+}
+
+// add the geometry as a new cache entry: in front when it is to be shown, right behind the shown one otherwise;
+// its buffers are allocated here and filled over the next frames by streamUploads(), unless the geometry was
+// generated straight into the target buffer of its job
+void cacheSponge(const SpongeKey& key, SpongeGeometry&& geometry, bool shown, const MappedBuffer& target)
+{
+    CachedSponge cached;
+    cached.key = key;
+    if (target.buffer != 0 &&
+        (geometry.vertices.inTarget() || geometry.compactVertices.inTarget() || geometry.instances.inTarget()))
+    {
+        cached.buffers.mapped = target;
+        if (!target.persistent)
+        {
+            // a buffer cannot be drawn while it is mapped without GL_MAP_PERSISTENT_BIT
+            glBindBuffer(GL_COPY_WRITE_BUFFER, target.buffer);
+            if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE)
+                std::cout << "Mapped vertex buffer lost its contents" << std::endl;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            cached.buffers.mapped.pointer = NULL;
+        }
+    }
+    else
+    {
+        retireMappedBuffer(target);
+    }
+    uploadSponge(cached.buffers, key, geometry);
+    if (cached.buffers.mapped.buffer == 0)
+        cached.staging.reset(new SpongeGeometry(std::move(geometry)));
+
+    std::list<CachedSponge>::iterator position = sponge_cache.begin();
+    if (!shown && position != sponge_cache.end())
+        ++position;
+    sponge_cache.insert(position, std::move(cached));
+    evictSponges();
+}
+
+// drop the least recently shown sponges until the cache fits cache_budget_mb; the shown one always stays
+void evictSponges()
+{
+    const size_t budget = (size_t)cache_budget_mb * 1024 * 1024;
+    while (sponge_cache.size() > 1 && cachedSpongeBytes() > budget)
+    {
+        deleteSpongeBuffers(sponge_cache.back().buffers);
+        sponge_cache.pop_back();
+    }
+}
+
+size_t cachedSpongeBytes()
+{
+    size_t bytes = 0;
+    for (const CachedSponge& cached : sponge_cache)
+        bytes += cached.buffers.vertexBytes + cached.buffers.indexBytes;
+    return bytes;
+}
+
+// show the sponge of the key: from the cache at once, otherwise when its generation finishes
+// (taking over the background job if it is building exactly this one); a stale generation is cancelled
+void selectSponge(const SpongeKey& key)
+{
+    if (!generatesGeometry(key.renderMode))
+    {
+        cancelJob(regeneration);
+        return;
+    }
+
+    double start = glfwGetTime();
+    for (std::list<CachedSponge>::iterator it = sponge_cache.begin(); it != sponge_cache.end(); ++it)
+    {
+        if (it->key == key)
+        {
+            cancelJob(regeneration);
+            sponge_cache.splice(sponge_cache.begin(), sponge_cache, it);
+            shown_from_cache = true;
+            generation_ms = (glfwGetTime() - start) * 1000.0;
+            return;
+        }
+    }
+
+    if (regeneration.result.valid() && regeneration.key == key)
+        return;
+    cancelJob(regeneration);
+    regeneration_peak_bytes = resident_bytes;
+    if (precompute.result.valid() && precompute.key == key)
+    {
+        regeneration = std::move(precompute);
+        precompute.target = MappedBuffer();
+    }
+    else
+        startJob(regeneration, key);
+}
+
+void startJob(GenerationJob& job, const SpongeKey& key)
+{
+    job.key = key;
+    job.progress = std::make_shared<MengerProgress>();
+    std::shared_ptr<MengerProgress> progress = job.progress;
+    unsigned int threadCount = (unsigned int)generation_threads;
+
+    // the size is known before generation, so the buffer can be mapped here on the GL thread and filled by the workers
+    job.target = MappedBuffer();
+    size_t bytes = zero_copy ? spongeStreamBytes(key) : 0;
+    if (bytes > 0)
+        job.target = acquireMappedBuffer(bytes);
+    void* target = job.target.pointer;
+
+    job.result = std::async(std::launch::async, [key, threadCount, progress, target, bytes]()
+    {
+        SpongeGeometry geometry;
+        geometry.vertices.target = geometry.compactVertices.target = geometry.instances.target = target;
+        geometry.vertices.targetBytes = geometry.compactVertices.targetBytes = geometry.instances.targetBytes = bytes;
+        generateSponge(geometry, key, threadCount, progress.get());
+        return geometry;
+    });
+}
+
+// the result of the job is not wanted any more: its remaining tasks are skipped and the job is dropped
+// by updateGenerationJobs() once the running ones finish, without blocking the render loop
+void cancelJob(GenerationJob& job)
+{
+    if (!job.result.valid())
+        return;
+    job.progress->cancelled = true;
+    stale_jobs.push_back(std::move(job));
+    job.target = MappedBuffer();
+}
+
+bool jobReady(const GenerationJob& job)
+{
+    return job.result.valid() && job.result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// called once per frame on the GL thread: a finished regeneration is uploaded and replaces the drawn sponge
+// between two frames, a finished neighbour is uploaded behind it; then the next neighbour depth is started
+// when renderMode draws generated sponges, nothing else is generating and it fits in the budget without
+// evicting anything
+void updateGenerationJobs(int renderMode)
+{
+    if (jobReady(regeneration))
+    {
+        SpongeGeometry geometry = regeneration.result.get();
+        generation_ms = geometry.generationMs;
+        cacheSponge(regeneration.key, std::move(geometry), true, regeneration.target);
+        regeneration.target = MappedBuffer();
+        shown_from_cache = false;
+    }
+
+    if (jobReady(precompute))
+    {
+        SpongeGeometry geometry = precompute.result.get();
+        // the settings may have changed meanwhile, the result is still worth keeping if it fits
+        if (findCachedSponge(precompute.key) == NULL &&
+            cachedSpongeBytes() + estimateSpongeBytes(precompute.key) <= (size_t)cache_budget_mb * 1024 * 1024)
+            cacheSponge(precompute.key, std::move(geometry), false, precompute.target);
+        else
+            retireMappedBuffer(precompute.target);
+        precompute.target = MappedBuffer();
+    }
+
+    for (std::list<GenerationJob>::iterator it = stale_jobs.begin(); it != stale_jobs.end();)
+    {
+        if (jobReady(*it))
+        {
+            // the cancelled generator has stopped writing into its buffer
+            retireMappedBuffer(it->target);
+            it = stale_jobs.erase(it);
+        }
+        else
+            ++it;
+    }
+
+    if (!precompute_neighbours || !generatesGeometry(renderMode) || sponge_cache.empty() ||
+        regeneration.result.valid() || precompute.result.valid())
+        return;
+
+    const int steps[2] = {1, -1};
+    for (int step : steps)
+    {
+        SpongeKey key = sponge_cache.front().key;
+        key.depth += step;
+        if (key.depth < 1 || key.depth > MAX_GENERATED_DEPTH || findCachedSponge(key) != NULL)
+            continue;
+        if (cachedSpongeBytes() + estimateSpongeBytes(key) > (size_t)cache_budget_mb * 1024 * 1024)
+            continue;
+
+        startJob(precompute, key);
+        return;
+    }
+}
+
+// wait for the generation jobs and delete every buffer of the cache, at exit; the futures of std::async wait for
+// their threads when destroyed, cancelled jobs finish quickly
+void deleteSpongeCache()
+{
+    cancelJob(regeneration);
+    cancelJob(precompute);
+    for (GenerationJob& job : stale_jobs)
+    {
+        job.result.wait();
+        retireMappedBuffer(job.target);
+    }
+    stale_jobs.clear();
+    for (CachedSponge& cached : sponge_cache)
+        deleteSpongeBuffers(cached.buffers);
+    sponge_cache.clear();
+    for (MappedBuffer& retired : retired_buffers)
+    {
+        glDeleteSync(retired.fence);
+        glDeleteBuffers(1, &retired.buffer);
+    }
+    retired_buffers.clear();
+}
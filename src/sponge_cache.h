@@ -0,0 +1,197 @@
+// Sponges generated on the CPU and kept on the GPU
+// A sponge is described by a SpongeKey and built by the generators of menger.h on a worker thread, straight into a
+// mapped GPU buffer when its size is known beforehand; the result is uploaded in chunks over the following frames and
+// kept in a cache of the most recently shown sponges, within a memory budget. A neighbouring depth can be generated
+// ahead of time, so stepping through the depths shows cached sponges. Everything but the generators runs on the GL
+// thread.
+
+#pragma once
+
+#include "menger.h"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <future>
+#include <list>
+#include <memory>
+#include <vector>
+
+// which faces of the sub-cubes end up in the vertex buffer
+enum GeometryMode
+{
+    GEOMETRY_FULL,          // all 6 faces of every cube
+    GEOMETRY_VISIBLE_FACES, // faces hidden between touching cubes skipped
+    GEOMETRY_GREEDY         // visible faces merged into maximal rectangles
+};
+
+// how the sponge is sent to the GPU
+enum RenderMode
+{
+    RENDER_VERTICES,  // every cube expanded to its own vertices
+    RENDER_INSTANCED, // one unit cube drawn once per (x, y, z, width) instance
+    RENDER_PROCEDURAL, // no buffers, cubes decoded from gl_InstanceID in the vertex shader
+    RENDER_INDEXED,    // 4 vertices per face shared by its 2 triangles through an element buffer
+    RENDER_LOD,        // cut of the cube hierarchy refined by screen-space error, drawn as instances
+    RENDER_RAYMARCH,   // no geometry, the signed distance of the sponge ray-marched for every pixel
+    RENDER_VOXEL,      // no geometry, rays traverse the lattice through a 27-tree of occupancy in a buffer texture
+    RENDER_CARPET,     // no geometry, the 2D Sierpinski carpet evaluated for every pixel, with pan and deep zoom
+    RENDER_FLY,        // ray marching from a free camera diving into the sponge, around a root cell that follows it
+    RENDER_COMPUTE     // visible faces generated on the GPU by a compute shader, drawn with glDrawArraysIndirect
+};
+
+// the sponge spans [SPONGE_X, SPONGE_X + SPONGE_WIDTH] etc.
+const float SPONGE_X = -0.8f;
+const float SPONGE_Y = -0.8f;
+const float SPONGE_Z = 0.0f;
+const float SPONGE_WIDTH = 1.8f;
+// deepest level of the CPU generated modes and of the procedural one
+const int MAX_GENERATED_DEPTH = 5;
+const int MAX_PROCEDURAL_DEPTH = 7;
+const int MAX_LOD_DEPTH = 8;
+// ray marching costs one more loop iteration per level, the limit is float precision of the finest holes
+const int MAX_RAYMARCH_DEPTH = 10;
+// the voxel traversal is exact, deeper levels only add steps through the holes
+const int MAX_VOXEL_DEPTH = 7;
+// frustum culling tests sub-trees down to this many levels below the whole sponge, at most 20^3 = 8000 cells
+const int CULL_CELL_LEVELS = 3;
+
+// everything that decides what is generated and uploaded for a sponge, the key of the geometry cache
+struct SpongeKey
+{
+    int depth = 1;
+    int renderMode = RENDER_VERTICES;
+    int geometryMode = GEOMETRY_FULL; // RENDER_VERTICES and RENDER_INDEXED only
+    bool compact = false;             // not for GEOMETRY_GREEDY
+    bool indices32 = false;           // RENDER_INDEXED only
+
+    bool operator==(const SpongeKey& other) const
+    {
+        return depth == other.depth && renderMode == other.renderMode && geometryMode == other.geometryMode &&
+               compact == other.compact && indices32 == other.indices32;
+    }
+};
+
+// output of the CPU generators for one key; touches no GL or global state, so it can be built on any thread
+struct SpongeGeometry
+{
+    VertexData vertices;
+    // lattice-quantized vertices, used instead of vertices for compact keys (not for GEOMETRY_GREEDY,
+    // its texture coordinates run over many lattice cells and do not fit in normalized bytes)
+    CompactVertexData compactVertices;
+    VertexData instances;
+    // element buffer of RENDER_INDEXED: one 16-bit chunk pattern reused with a base vertex, or 32-bit indices of the whole mesh
+    std::vector<unsigned short> chunkIndices;
+    std::vector<unsigned int> meshIndices;
+    // faces before every cell of frustum culling (mengerCellFaceOffsets()), empty for RENDER_INSTANCED, where a cell
+    // is a fixed number of instances, and for GEOMETRY_GREEDY, whose rectangles do not follow the cells
+    std::vector<size_t> cellFaces;
+    double generationMs = 0.0;
+};
+
+// GPU buffer the generator writes into directly: persistently mapped with GL_ARB_buffer_storage, otherwise mapped
+// with glMapBufferRange until the generation has finished
+struct MappedBuffer
+{
+    unsigned int buffer = 0;
+    void* pointer = NULL;
+    size_t bytes = 0;
+    bool persistent = false;
+    GLsync fence = 0; // retired buffers: signalled when the GPU has finished the last draw that read the buffer
+};
+
+// OpenGL objects of one uploaded sponge and what is needed to draw it
+struct SpongeBuffers
+{
+    unsigned int VAO = 0, VBO = 0;
+    unsigned int instanceVBO = 0; // RENDER_INSTANCED, VBO holds the unit cube
+    unsigned int EBO = 0;         // RENDER_INDEXED
+    int renderMode = RENDER_VERTICES;
+    size_t vertexCount = 0, instanceCount = 0, indexCount = 0;
+    bool compact = false, indices32 = false;
+    size_t vertexBytes = 0, indexBytes = 0; // instances counted with the vertices
+    double generationMs = 0.0;
+    // incremental upload: the vertices (instances of RENDER_INSTANCED) before readyCount are on the GPU and drawn
+    size_t readyCount = 0;
+    // zero-copy: the vertex (instance) buffer the geometry was generated into, already complete
+    MappedBuffer mapped;
+    // frustum culling: cells of cullCellLevels levels, 0 when the sponge is always drawn whole
+    int cullCellLevels = 0;
+    size_t cellCount = 0;
+    std::vector<size_t> cellFaces;
+};
+
+struct CachedSponge
+{
+    SpongeKey key;
+    SpongeBuffers buffers;
+    // CPU copy of the geometry, kept until streamUploads() has sent all of it
+    std::unique_ptr<SpongeGeometry> staging;
+    // has been drawn whole as the shown sponge
+    bool drawn = false;
+};
+
+// CPU generation of one sponge on its own thread, running while result is valid
+struct GenerationJob
+{
+    SpongeKey key;
+    std::shared_ptr<MengerProgress> progress;
+    std::future<SpongeGeometry> result;
+    MappedBuffer target; // written by the generator when it has a buffer
+};
+
+// uploaded sponges, most recently shown first; the front one is drawn once it is uploaded, see drawnSponge()
+extern std::list<CachedSponge> sponge_cache;
+extern int cache_budget_mb;
+extern bool precompute_neighbours;
+// time per frame spent copying vertices of new sponges to the GPU, the rest is sent in the following frames
+extern float upload_budget_ms;
+// the generators write straight into GPU buffer memory, with no CPU copy and no upload
+extern bool zero_copy;
+extern bool has_buffer_storage;
+// RENDER_COMPUTE runs on GL 4.3 contexts, down to the depth whose vertices fit in a shader storage block; elsewhere the
+// mode shows the visible faces of the CPU generator
+extern bool has_compute_shaders;
+extern int max_compute_depth;
+// mapped buffers of dropped sponges, reused for a sponge of the same size once their fence is signalled
+extern std::vector<MappedBuffer> retired_buffers;
+// the sponge of the current settings, being generated while the previous one is still drawn; a neighbouring
+// depth generated ahead of time; and cancelled jobs left to finish the tasks they already started
+extern GenerationJob regeneration;
+extern GenerationJob precompute;
+extern std::list<GenerationJob> stale_jobs;
+extern bool shown_from_cache;
+extern double generation_ms;
+extern int generation_threads; // 0 - all hardware threads
+// resident set of the process, sampled once per frame, and its highest sample while the shown sponge was generated
+// and uploaded
+extern size_t resident_bytes;
+extern size_t regeneration_peak_bytes;
+
+int maxDepthOf(int renderMode);
+bool generatesGeometry(int renderMode);
+int cullCellLevels(int depth);
+void generateSponge(SpongeGeometry& out, const SpongeKey& key, unsigned int threadCount, MengerProgress* progress);
+size_t estimateSpongeBytes(const SpongeKey& key);
+size_t spongeStreamBytes(const SpongeKey& key);
+size_t geometryBytes(const SpongeGeometry& geometry);
+MappedBuffer acquireMappedBuffer(size_t bytes);
+void retireMappedBuffer(MappedBuffer buffer);
+void setVertexAttributes();
+void fillInstanceBuffer(SpongeBuffers& buffers, const SpongeGeometry& geometry);
+void uploadSponge(SpongeBuffers& buffers, const SpongeKey& key, const SpongeGeometry& geometry);
+bool streamSponge(SpongeBuffers& buffers, const SpongeGeometry& geometry, double deadline);
+void streamUploads();
+void deleteSpongeBuffers(SpongeBuffers& buffers);
+size_t drawSponge(const SpongeBuffers& buffers, const std::vector<MengerCellRange>* ranges);
+const CachedSponge& drawnSponge();
+SpongeBuffers* findCachedSponge(const SpongeKey& key);
+void cacheSponge(const SpongeKey& key, SpongeGeometry&& geometry, bool shown, const MappedBuffer& target);
+void evictSponges();
+size_t cachedSpongeBytes();
+void selectSponge(const SpongeKey& key);
+void startJob(GenerationJob& job, const SpongeKey& key);
+void cancelJob(GenerationJob& job);
+bool jobReady(const GenerationJob& job);
+void updateGenerationJobs(int renderMode);
+void deleteSpongeCache();